@@ -0,0 +1,439 @@
+
+#include "../Declarative.h"
+#include "../DeclarativeCollections.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+
+static std::atomic<size_t> allocations = 0;
+
+// Every form of new and delete is replaced, so that each allocation is counted and freed by the
+// same allocator that made it.
+static void* allocate(size_t size) noexcept {
+	allocations++;
+	return std::malloc(size ? size : 1);
+}
+
+static void* allocate(size_t size, std::align_val_t alignment) noexcept {
+	allocations++;
+	size_t bytes = size_t(alignment);
+#ifdef _MSC_VER
+	return _aligned_malloc(size ? size : 1, bytes);
+#else
+	// aligned_alloc wants the size in whole multiples of the alignment.
+	return std::aligned_alloc(bytes, (std::max(size, size_t(1)) + bytes - 1) / bytes * bytes);
+#endif
+}
+
+// Kept out of line: GCC would otherwise see through an inlined delete to free() on memory from
+// new and warn about the mismatch.
+#ifdef __GNUC__
+#define OUT_OF_LINE __attribute__((noinline))
+#else
+#define OUT_OF_LINE
+#endif
+
+OUT_OF_LINE static void release(void* memory) noexcept {
+	std::free(memory);
+}
+
+OUT_OF_LINE static void release(void* memory, std::align_val_t) noexcept {
+#ifdef _MSC_VER
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+void* operator new(size_t size) {
+	if (void* memory = allocate(size))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+	if (void* memory = allocate(size, alignment))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return allocate(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return allocate(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+	release(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	release(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	release(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+	release(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+	release(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+	release(memory);
+}
+
+void operator delete(void* memory, std::align_val_t alignment) noexcept {
+	release(memory, alignment);
+}
+
+void operator delete[](void* memory, std::align_val_t alignment) noexcept {
+	release(memory, alignment);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept {
+	release(memory, alignment);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept {
+	release(memory, alignment);
+}
+
+void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	release(memory, alignment);
+}
+
+void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	release(memory, alignment);
+}
+
+
+// Times body, which performs the given number of operations, and reports the cost of one.
+template<typename Body>
+void measure(const char* name, size_t operations, Body&& body) {
+	size_t allocationsBefore = allocations;
+	auto start = std::chrono::steady_clock::now();
+
+	body();
+
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	size_t allocated = allocations - allocationsBefore;
+
+	double nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count();
+	std::cout << std::left << std::setw(40) << name << std::right << std::fixed
+		<< std::setw(12) << std::setprecision(2) << nanoseconds / operations << " ns/op"
+		<< std::setw(12) << std::setprecision(3) << double(allocated) / operations << " allocs/op"
+		<< std::endl;
+}
+
+
+void fanOut() {
+	const size_t reactions = 100000;
+	const size_t updates = 20;
+
+	Property<int> source = 0;
+	std::vector<std::unique_ptr<Reaction>> observers;
+	long long sum = 0;
+	for (size_t i = 0; i < reactions; i++) {
+		observers.push_back(std::make_unique<Reaction>([&]() { sum += source.getValue(); }));
+	}
+
+	measure("fan-out, per reaction run", reactions * updates, [&]() {
+		for (size_t i = 1; i <= updates; i++) {
+			source = int(i);
+		}
+	});
+}
+
+void deepChain() {
+	const size_t depth = 1000;
+	const size_t updates = 1000;
+
+	Property<int> source = 0;
+	std::vector<std::unique_ptr<Property<int>>> chain;
+	chain.push_back(std::make_unique<Property<int>>([&]() { return source.getValue() + 1; }));
+	for (size_t i = 1; i < depth; i++) {
+		Property<int>* previous = chain.back().get();
+		chain.push_back(std::make_unique<Property<int>>([previous]() { return previous->getValue() + 1; }));
+	}
+	int tail = 0;
+	Reaction observer([&]() { tail = chain.back()->getValue(); });
+
+	measure("deep chain, per node per update", depth * updates, [&]() {
+		for (size_t i = 1; i <= updates; i++) {
+			source = int(i);
+		}
+	});
+}
+
+// A pipeline far deeper than the call stack could take one call per level of. Each link is
+// evaluated as it is added, so only updates are measured.
+void deepPipeline() {
+	const size_t depth = 50000;
+	const size_t updates = 100;
+
+	Property<int> source = 0;
+	std::vector<std::unique_ptr<Property<int>>> chain;
+	chain.push_back(std::make_unique<Property<int>>([&]() { return source.getValue() + 1; }));
+	chain.back()->getValue();
+	for (size_t i = 1; i < depth; i++) {
+		Property<int>* previous = chain.back().get();
+		chain.push_back(std::make_unique<Property<int>>([previous]() { return previous->getValue() + 1; }));
+		chain.back()->getValue();
+	}
+	int tail = 0;
+	Reaction observer([&]() { tail = chain.back()->getValue(); });
+
+	measure("50k-deep pipeline, per node per update", depth * updates, [&]() {
+		for (size_t i = 1; i <= updates; i++) {
+			source = int(i);
+		}
+	});
+}
+
+void diamond() {
+	const size_t updates = 100000;
+
+	Property<int> top = 0;
+	Property<int> left{ [&]() { return top.getValue() + 1; } };
+	Property<int> right{ [&]() { return top.getValue() * 2; } };
+	Property<int> bottom{ [&]() { return left.getValue() + right.getValue(); } };
+	int seen = 0;
+	Reaction observer([&]() { seen = bottom.getValue(); });
+
+	measure("diamond, per update", updates, [&]() {
+		for (size_t i = 1; i <= updates; i++) {
+			top = int(i);
+		}
+	});
+}
+
+void setValueChurn() {
+	const size_t updates = 1000000;
+
+	Property<int> value = 0;
+	int seen = 0;
+	Reaction observer([&]() { seen = value.getValue(); });
+
+	measure("setValue churn, per set", updates, [&]() {
+		for (size_t i = 1; i <= updates; i++) {
+			value = int(i);
+		}
+	});
+
+	measure("setValue churn in transaction, per set", updates, [&]() {
+		transaction([&] {
+			for (size_t i = 1; i <= updates; i++) {
+				value = -int(i);
+			}
+		});
+	});
+}
+
+void dynamicDependencies() {
+	const size_t switches = 100000;
+
+	Property<bool> useLeft = true;
+	Property<int> left = 1;
+	Property<int> right = 2;
+	int seen = 0;
+	Reaction observer([&]() { seen = useLeft.getValue() ? left.getValue() : right.getValue(); });
+
+	measure("dependency switching, per switch", switches, [&]() {
+		for (size_t i = 0; i < switches; i++) {
+			useLeft = i % 2 == 0;
+		}
+	});
+}
+
+void repeatedReads() {
+	const size_t reads = 32;
+	const size_t updates = 100000;
+
+	Property<int> first = 0;
+	Property<int> second = 0;
+	long long sum = 0;
+	Reaction observer([&]() {
+		for (size_t i = 0; i < reads; i++) {
+			sum += first.getValue() + second.getValue();
+		}
+	});
+
+	measure("repeated reads in a reaction, per read", reads * 2 * updates, [&]() {
+		for (size_t i = 1; i <= updates; i++) {
+			first = int(i);
+		}
+	});
+
+	measure("untracked read, per read", updates * reads, [&]() {
+		for (size_t i = 0; i < updates * reads; i++) {
+			sum += first.getValue();
+		}
+	});
+}
+
+void derivedViews() {
+	const size_t rows = 100000;
+	const size_t updates = 10000;
+
+	PropertyList<int> table;
+	transaction([&] {
+		for (size_t i = 0; i < rows; i++) {
+			table.pushBack(int(i * 7919 % rows));
+		}
+	});
+	auto visible = filter(table, [](int value) { return value % 3 != 0; });
+	auto ordered = sortBy(visible.list(), [](int value) { return value; });
+	size_t shown = 0;
+	Reaction observer([&]() { shown = ordered.list().size(); });
+
+	measure("filter+sort over 100k rows, per row update", updates, [&]() {
+		for (size_t i = 0; i < updates; i++) {
+			table.set(i * 31 % rows, int(i));
+		}
+	});
+}
+
+void bulkArray() {
+	const size_t count = 1000000;
+	const size_t updates = 100;
+
+	PropertyArray<float> gauges(count);
+	std::vector<float> frame(count);
+	size_t uploaded = 0;
+	Reaction uploader([&]() { uploaded += gauges.scanDirty([](size_t, float) {}); });
+	float watched = 0;
+	Reaction observer([&]() { watched = gauges.get(count / 2); });
+
+	measure("property array bulk set, per element", count * updates, [&]() {
+		for (size_t i = 1; i <= updates; i++) {
+			for (size_t j = 0; j < count; j += 16) {
+				frame[j] = float(i);
+			}
+			gauges.setValues(frame);
+		}
+	});
+}
+
+void postedWrites() {
+	const size_t writes = 1000000;
+
+	ReactiveContext& context = ReactiveContext::get();
+	Property<int> value = 0;
+	int seen = 0;
+	Reaction observer([&]() { seen = value.getValue(); });
+
+	measure("posted from another thread, per write", writes, [&]() {
+		std::thread producer([&]() {
+			for (size_t i = 1; i <= writes; i++) {
+				context.post(value, int(i));
+			}
+		});
+		size_t applied = 0;
+		while (applied < writes) {
+			applied += context.runPosted();
+		}
+		producer.join();
+	});
+}
+
+void snapshotRestore() {
+	const size_t nodes = 100000;
+
+	struct Scene {
+		Property<int> source = 1;
+		std::vector<std::unique_ptr<Property<int>>> computed;
+		std::vector<std::unique_ptr<Reaction>> observers;
+		long long sum = 0;
+
+		Scene(size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				// Stands in for a binding that does real work, e.g. laying out a widget.
+				computed.push_back(std::make_unique<Property<int>>([this, i]() {
+					unsigned value = unsigned(source.getValue() + int(i));
+					for (unsigned k = 0; k < 256; k++) {
+						value = value * 2654435761u + k;
+					}
+					return int(value);
+				}));
+				Property<int>* value = computed.back().get();
+				observers.push_back(std::make_unique<Reaction>([this, value]() { sum += value->getValue(); }));
+			}
+		}
+	};
+
+	std::stringstream stream;
+	{
+		GraphSnapshot snapshot;
+		std::unique_ptr<Scene> scene;
+		measure("build without snapshot, per binding", nodes, [&]() {
+			GraphSnapshot::Scope scope(snapshot);
+			scene = std::make_unique<Scene>(nodes);
+		});
+		snapshot.save(stream);
+	}
+
+	GraphSnapshot snapshot;
+	snapshot.load(stream);
+	std::unique_ptr<Scene> scene;
+	measure("build from snapshot, per binding", nodes, [&]() {
+		GraphSnapshot::Scope scope(snapshot);
+		scene = std::make_unique<Scene>(nodes);
+	});
+}
+
+void createDestroy() {
+	const size_t iterations = 100000;
+
+	measure("create/destroy, per property+reaction", iterations, [&]() {
+		for (size_t i = 0; i < iterations; i++) {
+			Property<int> value = int(i);
+			Property<int> doubled{ [&]() { return value.getValue() * 2; } };
+			int seen = 0;
+			Reaction observer([&]() { seen = doubled.getValue(); });
+		}
+	});
+}
+
+
+int main() {
+	fanOut();
+	deepChain();
+	deepPipeline();
+	diamond();
+	setValueChurn();
+	dynamicDependencies();
+	repeatedReads();
+	derivedViews();
+	bulkArray();
+	postedWrites();
+	snapshotRestore();
+	createDestroy();
+	return 0;
+}
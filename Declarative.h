@@ -0,0 +1,2609 @@
+#pragma once
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <cstring>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <concepts>
+#include <ostream>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <istream>
+#include <typeinfo>
+
+
+class PropertyBase;
+class ReactionBase;
+class Reaction;
+template<typename T>
+class Property;
+
+
+template<typename T>
+class ValueGuard{
+	T& reference;
+	T value;
+public:
+	ValueGuard(T& reference) : reference(reference), value(reference) {}
+
+	~ValueGuard() {
+		reference = value;
+	}
+};
+
+// Move-only callable that always stores its target inline, so binding a lambda never
+// allocates. The default capacity keeps the whole object within one cache line, which
+// fits the usual [this] / [&] bindings with room to spare.
+template<typename Signature, size_t Capacity = 6 * sizeof(void*)>
+class InplaceFunction;
+
+template<typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity> {
+	using Invoker = R(*)(void* target, Args&&... args);
+	using Relocator = void(*)(void* target, void* destination);
+
+	alignas(std::max_align_t) unsigned char storage[Capacity];
+	Invoker invoker = nullptr;
+	// Moves the target into destination and destroys it; destination is null on plain destruction.
+	// Left null for trivially copyable targets, which are relocated by copying the storage.
+	Relocator relocator = nullptr;
+
+	void moveFrom(InplaceFunction& other) {
+		if (other.relocator)
+			other.relocator(other.storage, storage);
+		else if (other.invoker)
+			std::memcpy(storage, other.storage, Capacity);
+		invoker = other.invoker;
+		relocator = other.relocator;
+		other.invoker = nullptr;
+		other.relocator = nullptr;
+	}
+
+public:
+	InplaceFunction() = default;
+
+	InplaceFunction(std::nullptr_t) {}
+
+	template<typename F, typename Target = std::decay_t<F>, class enable = std::enable_if_t<
+		!std::is_same_v<Target, InplaceFunction> && std::is_invocable_r_v<R, Target&, Args...>>>
+	InplaceFunction(F&& function) {
+		static_assert(sizeof(Target) <= Capacity, "Binding captures too much state to be stored inline");
+		static_assert(alignof(Target) <= alignof(std::max_align_t), "Binding is over-aligned");
+
+		new (storage) Target(std::forward<F>(function));
+		invoker = [](void* target, Args&&... args) -> R {
+			return (*static_cast<Target*>(target))(std::forward<Args>(args)...);
+		};
+		if constexpr (!std::is_trivially_copyable_v<Target>) {
+			relocator = [](void* target, void* destination) {
+				if (destination)
+					new (destination) Target(std::move(*static_cast<Target*>(target)));
+				static_cast<Target*>(target)->~Target();
+			};
+		}
+	}
+
+	InplaceFunction(const InplaceFunction&) = delete;
+
+	InplaceFunction(InplaceFunction&& other) noexcept {
+		moveFrom(other);
+	}
+
+	InplaceFunction& operator = (InplaceFunction&& other) noexcept {
+		if (this != &other) {
+			reset();
+			moveFrom(other);
+		}
+		return *this;
+	}
+
+	~InplaceFunction() {
+		reset();
+	}
+
+	void reset() {
+		if (relocator)
+			relocator(storage, nullptr);
+		invoker = nullptr;
+		relocator = nullptr;
+	}
+
+	explicit operator bool() const {
+		return invoker != nullptr;
+	}
+
+	R operator()(Args... args) {
+		return invoker(storage, std::forward<Args>(args)...);
+	}
+};
+
+
+// Runs batches of independent tasks on a fixed set of threads. Tasks are dealt out to
+// per-thread deques and idle threads steal from the others, so uneven tasks still balance.
+// The calling thread works on the batch too and gets the last slot.
+class WorkStealingPool {
+public:
+	using Task = InplaceFunction<void(size_t index, size_t slot)>;
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex batchMutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	Task* task = nullptr;
+	std::atomic<size_t> remaining = 0;
+	unsigned long long generation = 0;
+	bool stopping = false;
+
+	bool take(size_t slot, size_t& index) {
+		if (slot < workers.size()) {
+			Worker& own = *workers[slot];
+			std::lock_guard lock(own.mutex);
+			if (!own.tasks.empty()) {
+				index = own.tasks.back();
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		for (size_t i = 1; i <= workers.size(); i++) {
+			Worker& victim = *workers[(slot + i) % workers.size()];
+			std::lock_guard lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				index = victim.tasks.front();
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void drain(size_t slot) {
+		size_t index;
+		while (take(slot, index)) {
+			(*task)(index, slot);
+			if (--remaining == 0) {
+				std::lock_guard lock(batchMutex);
+				done.notify_all();
+			}
+		}
+	}
+
+	void work(size_t slot) {
+		unsigned long long seen = 0;
+		for (;;) {
+			{
+				std::unique_lock lock(batchMutex);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+			}
+			drain(slot);
+		}
+	}
+
+public:
+	WorkStealingPool(size_t threads = std::max(1u, std::thread::hardware_concurrency()) - 1) {
+		for (size_t i = 0; i < threads; i++) {
+			workers.push_back(std::make_unique<Worker>());
+		}
+		for (size_t i = 0; i < threads; i++) {
+			workers[i]->thread = std::thread([this, i] { work(i); });
+		}
+	}
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+
+	~WorkStealingPool() {
+		{
+			std::lock_guard lock(batchMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers) {
+			worker->thread.join();
+		}
+	}
+
+	size_t slots() const {
+		return workers.size() + 1;
+	}
+
+	void run(size_t count, Task& batch) {
+		if (count == 0)
+			return;
+
+		task = &batch;
+		remaining = count;
+		for (size_t index = 0; index < count; index++) {
+			if (workers.empty())
+				break;
+			Worker& worker = *workers[index % workers.size()];
+			std::lock_guard lock(worker.mutex);
+			worker.tasks.push_back(index);
+		}
+		if (workers.empty()) {
+			for (size_t index = 0; index < count; index++) {
+				batch(index, 0);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard lock(batchMutex);
+			generation++;
+		}
+		wake.notify_all();
+
+		drain(workers.size());
+
+		std::unique_lock lock(batchMutex);
+		done.wait(lock, [&] { return remaining == 0; });
+	}
+};
+
+
+struct Dependency {
+	PropertyBase* property;
+	ReactionBase* reaction;
+
+	Dependency* prevDependent;
+	Dependency* nextDependent;
+
+	Dependency* prevTrigger;
+	Dependency* nextTrigger;
+
+	unsigned epoch;
+	unsigned long long observedVersion;
+};
+
+class DependencyPool {
+	std::pmr::memory_resource* memoryResource;
+	std::pmr::vector<std::pair<Dependency*, size_t>> chunks;
+	Dependency* freeList = nullptr;
+	size_t chunkSize = 64;
+	size_t handles = 0;
+	// Set by an owner that went away while handles were still held.
+	void (*destroyOwner)(void*) = nullptr;
+	void* owner = nullptr;
+
+	void grow() {
+		Dependency* chunk = static_cast<Dependency*>(memoryResource->allocate(chunkSize * sizeof(Dependency), alignof(Dependency)));
+		chunks.emplace_back(chunk, chunkSize);
+		for (size_t i = 0; i < chunkSize; i++) {
+			chunk[i].nextTrigger = i + 1 < chunkSize ? &chunk[i + 1] : freeList;
+		}
+		freeList = chunk;
+		if (chunkSize < 4096)
+			chunkSize *= 2;
+	}
+
+public:
+	DependencyPool(std::pmr::memory_resource* memoryResource = std::pmr::new_delete_resource())
+		: memoryResource(memoryResource), chunks(memoryResource) {}
+
+	DependencyPool(const DependencyPool&) = delete;
+
+	~DependencyPool() {
+		for (auto [chunk, size] : chunks) {
+			memoryResource->deallocate(chunk, size * sizeof(Dependency), alignof(Dependency));
+		}
+	}
+
+	std::pmr::memory_resource* resource() const {
+		return memoryResource;
+	}
+
+	Dependency* allocate() {
+		if (!freeList)
+			grow();
+		Dependency* dependency = freeList;
+		freeList = dependency->nextTrigger;
+		return dependency;
+	}
+
+	void release(Dependency* dependency) {
+		dependency->nextTrigger = freeList;
+		freeList = dependency;
+	}
+
+	// Held by every node built against the pool, so an owner that goes away first can leave
+	// the pool to them.
+	class Handle {
+		DependencyPool* pool;
+	public:
+		Handle(DependencyPool& pool) : pool(&pool) {
+			pool.handles++;
+		}
+
+		Handle(const Handle&) = delete;
+
+		~Handle() {
+			if (--pool->handles == 0 && pool->destroyOwner)
+				pool->destroyOwner(pool->owner);
+		}
+	};
+
+	// destroy(owner) is called right away if no handles are held, or else once the last one
+	// is dropped.
+	void abandon(void (*destroy)(void*), void* owner) {
+		if (handles == 0) {
+			destroy(owner);
+			return;
+		}
+		destroyOwner = destroy;
+		this->owner = owner;
+	}
+};
+
+// Graph bookkeeping of every node constructed inside a GraphArena::Scope is taken from
+// the arena and freed with it in one go, so the arena has to outlive those nodes.
+class GraphArena {
+	std::pmr::monotonic_buffer_resource memoryResource;
+
+public:
+	DependencyPool dependencyPool{ &memoryResource };
+
+	GraphArena(size_t initialSize = 16 * 1024) : memoryResource(initialSize) {}
+
+	GraphArena(const GraphArena&) = delete;
+
+	inline static thread_local GraphArena* current{};
+
+	class Scope {
+		ValueGuard<GraphArena*> guard{ current };
+	public:
+		Scope(GraphArena& arena) {
+			current = &arena;
+		}
+	};
+};
+
+
+// Stores a value as its bytes. Only right for types that hold no pointers or references into
+// memory of this run, so it is opt-in beyond arithmetic and enum types:
+//   template<> struct SnapshotTraits<Point> : SnapshotBytes<Point> {};
+template<typename T>
+struct SnapshotBytes {
+	static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be stored as bytes");
+
+	static constexpr bool supported = true;
+
+	static void write(std::string& data, const T& value) {
+		data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	static bool read(const std::string& data, T& value) {
+		if (data.size() != sizeof(T))
+			return false;
+		std::memcpy(&value, data.data(), sizeof(T));
+		return true;
+	}
+};
+
+// How a value of type T is written to a GraphSnapshot. Arithmetic and enum types are stored
+// as their bytes; specialize it for others. Nodes of types it is not defined for are
+// recomputed when the snapshot is restored.
+template<typename T, class enable = void>
+struct SnapshotTraits {
+	static constexpr bool supported = false;
+};
+
+template<typename T>
+struct SnapshotTraits<T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>> : SnapshotBytes<T> {};
+
+template<>
+struct SnapshotTraits<std::string> {
+	static constexpr bool supported = true;
+
+	static void write(std::string& data, const std::string& value) {
+		data += value;
+	}
+
+	static bool read(const std::string& data, std::string& value) {
+		value = data;
+		return true;
+	}
+};
+
+// Values and dependency edges of the Property and Reaction nodes created in its Scope, so the
+// next launch can rebuild the same graph without running every binding. Nodes are identified
+// by the order they are created in, so the code inside the Scope has to create the same
+// nodes in the same order each time; nodes that bindings create while running are not
+// covered. Every node recorded has to still exist when the snapshot is saved or restored.
+//
+// A Scope over a fresh snapshot just records the nodes, to be save()d once the graph has
+// settled. A Scope over a snapshot that was load()ed restores it: reactions created in it
+// do not run, and when the Scope ends every node gets its recorded value and edges back.
+// Sources whose current value differs from the recorded one then update as if set, so only
+// what depends on them runs. If the graph turns out not to match the snapshot, everything
+// runs as it would have without one.
+class GraphSnapshot {
+public:
+	class Scope {
+		GraphSnapshot& snapshot;
+		bool outermost = current != &snapshot;
+		ValueGuard<GraphSnapshot*> guard{ current };
+	public:
+		Scope(GraphSnapshot& snapshot) : snapshot(snapshot) {
+			current = &snapshot;
+		}
+
+		Scope(const Scope&) = delete;
+
+		// Restoring may run reactions, and so throw like a transaction does.
+		~Scope() noexcept(false) {
+			if (outermost && snapshot.restoring && std::uncaught_exceptions() == 0) {
+				current = nullptr;
+				snapshot.finish();
+			}
+		}
+	};
+
+	GraphSnapshot() = default;
+
+	GraphSnapshot(const GraphSnapshot&) = delete;
+
+	void save(std::ostream& stream);
+	// Returns false, leaving the snapshot to record a new graph instead, if stream does not
+	// hold a snapshot.
+	bool load(std::istream& stream);
+
+	// Whether the last Scope restored the graph from the snapshot rather than running it.
+	bool restored() const {
+		return wasRestored;
+	}
+
+	// Runs function with no snapshot in effect, for nodes that are an implementation detail
+	// of another one and are not created in a fixed order.
+	template<typename Function>
+	static decltype(auto) excluded(Function&& function) {
+		ValueGuard<GraphSnapshot*> _(current);
+		current = nullptr;
+		return std::forward<Function>(function)();
+	}
+
+	static void enroll(PropertyBase* property) {
+		if (current)
+			current->nodes.push_back({ property, nullptr });
+	}
+
+	// Returns true if the reaction is not to run now, the snapshot restoring it instead.
+	static bool enroll(Reaction* reaction) {
+		if (!current)
+			return false;
+		current->nodes.push_back({ nullptr, reaction });
+		return current->restoring;
+	}
+
+private:
+	struct Node {
+		PropertyBase* property;
+		Reaction* reaction;
+	};
+
+	struct Record {
+		size_t type = 0;
+		bool reaction = false;
+		bool computed = false;
+		// Up to date and with all its edges leading to recorded nodes.
+		bool complete = false;
+		bool hasValue = false;
+		unsigned height = 0;
+		unsigned long long version = 0;
+		std::string value;
+		std::vector<std::pair<unsigned, unsigned long long>> edges;
+	};
+
+	inline static thread_local GraphSnapshot* current{};
+
+	std::vector<Node> nodes;
+	std::vector<Record> records;
+	bool restoring = false;
+	bool wasRestored = false;
+
+	bool matches();
+	void finish();
+	void restore();
+	void runEverything();
+};
+
+
+// Min-heap of pending reactions keyed by rank, one above the highest property they read,
+// so a reaction only runs once everything upstream of it has settled. Ties run in the
+// order they were queued.
+class DeferredQueue {
+	std::vector<Reaction*> heap;
+	unsigned long long lastSequence = 0;
+
+	static bool before(const Reaction* a, const Reaction* b);
+	void place(Reaction* reaction, size_t index);
+	void siftUp(size_t index);
+	void siftDown(size_t index);
+
+public:
+	static constexpr size_t notQueued = ~size_t(0);
+
+	bool empty() const {
+		return heap.empty();
+	}
+
+	size_t size() const {
+		return heap.size();
+	}
+
+	Reaction* top() const {
+		return heap.front();
+	}
+
+	void push(Reaction* reaction);
+	Reaction* pop();
+	void remove(Reaction* reaction);
+	// Moves a queued reaction back after its rank went up.
+	void rankRaised(Reaction* reaction);
+	void clear();
+};
+
+
+// Unbounded multi-producer, single-consumer queue of writes to run on the thread that owns
+// a graph. Producers link their node in with a single exchange and never wait; the consumer
+// follows the links from the other end. This is Vyukov's intrusive queue: a producer
+// preempted between the exchange and linking its predecessor leaves the chain briefly cut,
+// in which case pop() reports the queue empty until the link shows up.
+class SubmissionQueue {
+public:
+	struct Node {
+		std::atomic<Node*> next = nullptr;
+
+		virtual ~Node() = default;
+		virtual void run() {}
+	};
+
+private:
+	template<typename F>
+	struct Submission : Node {
+		F function;
+
+		Submission(F&& function) : function(std::move(function)) {}
+
+		virtual void run() override {
+			function();
+		}
+	};
+
+	Node stub;
+	// Producers' end.
+	alignas(64) std::atomic<Node*> head = &stub;
+	// Consumer's end, only touched by the owning thread.
+	alignas(64) Node* tail = &stub;
+
+	void link(Node* node) {
+		node->next.store(nullptr, std::memory_order_relaxed);
+		Node* previous = head.exchange(node, std::memory_order_acq_rel);
+		previous->next.store(node, std::memory_order_release);
+	}
+
+public:
+	SubmissionQueue() = default;
+
+	SubmissionQueue(const SubmissionQueue&) = delete;
+
+	~SubmissionQueue() {
+		while (Node* node = pop()) {
+			delete node;
+		}
+	}
+
+	// Safe from any thread.
+	template<typename F>
+	void push(F function) {
+		link(new Submission<F>(std::move(function)));
+	}
+
+	// Owning thread only. The node returned belongs to the caller.
+	Node* pop() {
+		Node* node = tail;
+		Node* next = node->next.load(std::memory_order_acquire);
+		if (node == &stub) {
+			if (!next)
+				return nullptr;
+			tail = node = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+		if (next) {
+			tail = next;
+			return node;
+		}
+		if (node != head.load(std::memory_order_acquire))
+			return nullptr;
+
+		// node is the last one: put the stub behind it so it can be handed out.
+		link(&stub);
+		next = node->next.load(std::memory_order_acquire);
+		if (next) {
+			tail = next;
+			return node;
+		}
+		return nullptr;
+	}
+
+	// Owning thread only.
+	bool empty() const {
+		Node* node = tail;
+		return node == &stub && !node->next.load(std::memory_order_acquire);
+	}
+};
+
+
+#if DECLARATIVE_INSTRUMENTATION
+// Compiled in only when DECLARATIVE_INSTRUMENTATION is defined to 1; otherwise neither the
+// counters nor the code that bumps them exist.
+struct GraphStatistics {
+	unsigned long long recomputes = 0;
+	// Recomputes that produced a value equal to the previous one.
+	unsigned long long redundantRecomputes = 0;
+	unsigned long long reactionRuns = 0;
+	unsigned long long edgesAdded = 0;
+	unsigned long long edgesRemoved = 0;
+	unsigned long long flushes = 0;
+	// Reactions taken off the deferred queue, summed over all flushes.
+	unsigned long long flushIterations = 0;
+
+	GraphStatistics& operator+=(const GraphStatistics& other) {
+		recomputes += other.recomputes;
+		redundantRecomputes += other.redundantRecomputes;
+		reactionRuns += other.reactionRuns;
+		edgesAdded += other.edgesAdded;
+		edgesRemoved += other.edgesRemoved;
+		flushes += other.flushes;
+		flushIterations += other.flushIterations;
+		return *this;
+	}
+};
+
+struct NodeStatistics {
+	unsigned long long executions = 0;
+	unsigned long long redundantExecutions = 0;
+	// Reads of a node this one had already read in the same execution.
+	unsigned long long repeatedReads = 0;
+	// Inclusive: covers upstream nodes brought up to date while this one executed.
+	std::chrono::nanoseconds executionTime{};
+};
+
+// One per transaction, from the outermost guard being taken to its flush completing.
+struct TraceEvent {
+	const char* name;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::nanoseconds duration;
+	unsigned long long reactionsRun;
+};
+
+// Writes trace events in the Chrome trace JSON format, which chrome://tracing and Perfetto
+// both open. Install it on a context with
+//   context.traceHook = [&writer](const TraceEvent& event) { writer.write(event); };
+class ChromeTraceWriter {
+	std::ostream& stream;
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	bool first = true;
+
+	static std::string microseconds(std::chrono::nanoseconds duration) {
+		long long nanoseconds = duration.count();
+		return std::to_string(nanoseconds / 1000) + "." + std::to_string(1000 + nanoseconds % 1000).substr(1);
+	}
+
+public:
+	ChromeTraceWriter(std::ostream& stream) : stream(stream) {
+		stream << "[";
+	}
+
+	ChromeTraceWriter(const ChromeTraceWriter&) = delete;
+
+	~ChromeTraceWriter() {
+		stream << "\n]\n";
+	}
+
+	void write(const TraceEvent& event) {
+		stream << (first ? "\n" : ",\n");
+		first = false;
+		stream << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+			<< ",\"ts\":" << microseconds(event.start - origin)
+			<< ",\"dur\":" << microseconds(event.duration)
+			<< ",\"args\":{\"reactions\":" << event.reactionsRun << "}}";
+	}
+};
+#endif
+
+
+// Everything the engine tracks while a graph is being evaluated. Each thread gets its own
+// context by default; a Scope makes another one current, which lets independent graphs run
+// side by side. A graph must only ever be touched through the context it was built in.
+class ReactiveContext {
+public:
+	ReactionBase* current{};
+	size_t transactionDepth = 0;
+	DeferredQueue deferred{};
+	DependencyPool dependencyPool{};
+	unsigned long long lastFlushId = 0;
+
+	// Opt-in: when set, pure reactions of equal rank are flushed concurrently on this pool.
+	WorkStealingPool* parallelFlush{};
+	// Only set on the contexts that run a parallel batch, for the duration of the batch.
+	std::recursive_mutex* graphMutex{};
+	std::vector<std::unique_ptr<ReactiveContext>> workerContexts{};
+	std::vector<Reaction*> parallelBatch{};
+	std::vector<PropertyBase*> propagationStack{};
+	std::vector<std::pair<ReactionBase*, Dependency*>> validationStack{};
+	std::vector<ReactionBase*> suspensionStack{};
+	bool suspending = false;
+	// The reaction the flush is running and the property whose dependents are being dirtied,
+	// recorded on every reaction queued so a cycle can be traced back.
+	Reaction* flushing{};
+	PropertyBase* dirtiedThrough{};
+	unsigned long long lastCycleWalk = 0;
+	// Numbers the records above; bumped by every flush, and whenever a node they may point
+	// at goes away.
+	unsigned long long queueLinkEpoch = 0;
+	// Backstop for loops the records cannot be followed through: a reaction taken off the
+	// queue more often than this in one flush is reported as cyclic.
+	unsigned reentryLimit = 1000;
+
+	// When set, transactions ending only leave the reactions they reached queued, and the host
+	// loop drains them once per frame with runFrame(). Lazy properties still update on read.
+	bool frameScheduling = false;
+
+	// Writes posted from other threads, waiting for runPosted().
+	SubmissionQueue posted{};
+
+#if DECLARATIVE_INSTRUMENTATION
+	GraphStatistics statistics{};
+	// Called once for every transaction this context flushes.
+	InplaceFunction<void(const TraceEvent&)> traceHook{};
+	std::chrono::steady_clock::time_point transactionStart{};
+#endif
+
+	ReactiveContext() = default;
+
+	ReactiveContext(const ReactiveContext&) = delete;
+
+	// Runs the reactions queued since the last frame. Once budget is used up the rest is left
+	// for the next frame; returns how many that is.
+	size_t runFrame(std::chrono::nanoseconds budget = std::chrono::nanoseconds::max());
+
+	// Drops whatever the current transaction still had to run, e.g. when it throws.
+	void abandonTransaction();
+
+	// May be called from any thread: queues setting property to value, which happens when
+	// the thread this context belongs to next calls runPosted() or runFrame(). property has
+	// to outlive that.
+	template<typename T, typename U>
+	void post(Property<T>& property, U&& value) {
+		posted.push([&property, value = T(std::forward<U>(value))]() mutable { property.setValue(std::move(value)); });
+	}
+
+	// Same, for an arbitrary update, e.g. one touching several properties or a collection.
+	template<typename F>
+	void post(F&& update) {
+		posted.push(std::decay_t<F>(std::forward<F>(update)));
+	}
+
+	// Owning thread only: applies everything posted so far in a single transaction and
+	// returns how many updates that was.
+	size_t runPosted();
+
+	// Called when a node goes away mid-flush and may still be referenced by those records.
+	// Only the records go stale: which reactions already ran in this flush is kept, and
+	// cycle detection follows the links recorded after this point.
+	void forgetQueueLinks() {
+		++queueLinkEpoch;
+		dirtiedThrough = nullptr;
+	}
+
+	static ReactiveContext& get() {
+		if (!active)
+			active = &threadDefault();
+		return *active;
+	}
+
+	class Scope {
+		ValueGuard<ReactiveContext*> guard{ active };
+	public:
+		Scope(ReactiveContext& context) {
+			active = &context;
+		}
+	};
+
+private:
+	inline static thread_local ReactiveContext* active{};
+
+	// Nodes with static or thread storage duration may be destroyed after the thread's
+	// locals, and still use the context then. Each node holds a handle on its pool, so on
+	// thread exit the context is only deleted once the last of them is gone.
+	class ThreadDefault {
+	public:
+		ReactiveContext* context = new ReactiveContext();
+
+		ThreadDefault() = default;
+
+		ThreadDefault(const ThreadDefault&) = delete;
+
+		~ThreadDefault() {
+			context->dependencyPool.abandon([](void* owner) { delete static_cast<ReactiveContext*>(owner); }, context);
+		}
+	};
+
+	static ReactiveContext& threadDefault() {
+		thread_local ThreadDefault holder{};
+		return *holder.context;
+	}
+};
+
+// Guards the state that nodes share (dependents lists, pools, cached values) while a parallel
+// batch is running; a no-op the rest of the time.
+class GraphLock {
+	std::recursive_mutex* mutex;
+public:
+	GraphLock(ReactiveContext& context) : mutex(context.graphMutex) {
+		if (mutex)
+			mutex->lock();
+	}
+
+	GraphLock(const GraphLock&) = delete;
+
+	~GraphLock() {
+		if (mutex)
+			mutex->unlock();
+	}
+};
+
+
+// Clean nodes are up to date. Dirty ones read a source that definitely changed and have to
+// re-run. Check is pushed to everything further downstream: those nodes only re-run if
+// bringing their sources up to date turns out to change one of them.
+enum class Freshness : unsigned char {
+	Clean,
+	Check,
+	Dirty,
+};
+
+// How a computed property keeps itself up to date. Lazy ones recompute when read, Eager ones
+// as soon as their transaction flushes. AutoSuspend ones behave lazily while observed and drop
+// their upstream subscriptions as soon as nothing depends on them, so they stop being dirtied
+// at all until read again.
+enum class Evaluation : unsigned char {
+	Lazy,
+	Eager,
+	AutoSuspend,
+};
+
+class ReactionBase {
+	friend class PropertyBase;
+	friend class GraphSnapshot;
+	friend class GraphInspector;
+protected:
+	bool dirtImmune = false;
+	Dependency* firstTrigger = nullptr;
+	Dependency* lastTrigger = nullptr;
+	Dependency* trackingCursor = nullptr;
+	unsigned trackingEpoch = 0;
+	unsigned rank = 0;
+	Freshness freshness = Freshness::Clean;
+	DependencyPool* dependencyPool = GraphArena::current ? &GraphArena::current->dependencyPool : &ReactiveContext::get().dependencyPool;
+	// Keeps the context it was built in alive for as long as the node is.
+	DependencyPool::Handle contextHandle{ ReactiveContext::get().dependencyPool };
+
+#if DECLARATIVE_INSTRUMENTATION
+	NodeStatistics statistics{};
+
+	class ExecutionTimer {
+		NodeStatistics& statistics;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	public:
+		ExecutionTimer(NodeStatistics& statistics) : statistics(statistics) {
+			statistics.executions++;
+		}
+
+		~ExecutionTimer() {
+			statistics.executionTime += std::chrono::steady_clock::now() - start;
+		}
+	};
+#endif
+
+	void beginTracking();
+	void endTracking();
+	unsigned rankSoFar() const;
+	bool sourcesChanged();
+	void restampTriggers();
+	void suspend();
+
+private:
+	void insertTriggerAfterCursor(Dependency* dependency);
+	void removeTrigger(Dependency* dependency);
+	void releaseTriggersFrom(Dependency* dependency);
+
+public:
+	ReactionBase() = default;
+
+	ReactionBase(const ReactionBase&) = delete;
+
+	virtual ~ReactionBase() {
+		unsubscribeFromTriggeringProperties();
+	}
+
+	void addTriggeringProperty(PropertyBase* property);
+	void unsubscribeFromTriggeringProperties();
+	// Returns the node as a property if its own dependents still have to be told.
+	virtual PropertyBase* makeDirty(Freshness freshness) = 0;
+	// The node's property side, if it has one.
+	virtual PropertyBase* propertySide() { return nullptr; }
+
+#if DECLARATIVE_INSTRUMENTATION
+	const NodeStatistics& getStatistics() const {
+		return statistics;
+	}
+#endif
+};
+
+// Thrown when a flush finds a reaction re-triggered by its own run, directly or through other
+// reactions. chain names the nodes along the loop in the order the change travelled, starting
+// and ending with the same reaction.
+class CyclicBindingError : public std::runtime_error {
+	static std::string describe(const std::vector<std::string>& chain) {
+		std::string message = "Cyclic property binding: ";
+		for (size_t i = 0; i < chain.size(); i++) {
+			if (i > 0)
+				message += " -> ";
+			message += chain[i];
+		}
+		return message;
+	}
+
+public:
+	std::vector<std::string> chain;
+
+	CyclicBindingError(std::vector<std::string> chain) : std::runtime_error(describe(chain)), chain(std::move(chain)) {}
+};
+
+class Reaction: public ReactionBase {
+	friend class DeferredQueue;
+	friend class ReactiveContext;
+public:
+	using Function = InplaceFunction<void()>;
+
+	Function function;
+
+	// A pure reaction only reads the graph: it writes no properties and creates no nodes, so
+	// pure reactions of equal rank may run at the same time under a parallel flush.
+	bool pure = false;
+
+private:
+	const char* name = nullptr;
+	size_t queueIndex = DeferredQueue::notQueued;
+	unsigned long long queueSequence = 0;
+	unsigned long long flushId = 0;
+	// The reaction whose run queued this one and the property it was reached through, valid
+	// while queuedInEpoch is the context's queueLinkEpoch.
+	Reaction* queuedBy = nullptr;
+	PropertyBase* queuedThrough = nullptr;
+	unsigned long long queuedInEpoch = 0;
+	unsigned long long cycleWalk = 0;
+	unsigned runsInFlush = 0;
+
+public:
+	Reaction(Function function, bool pure = false) : pure(pure) {
+		this->function = std::move(function);
+		freshness = Freshness::Dirty;
+		if (GraphSnapshot::enroll(this))
+			return;
+
+		ReactiveContext& context = ReactiveContext::get();
+		if (context.transactionDepth > 0) {
+			context.deferred.push(this);
+		}
+		else {
+			Reaction::DeferredGuard d{};
+			execute();
+		}
+	}
+
+	Reaction(const Reaction&) = delete;
+
+	~Reaction() {
+		dispose();
+	}
+
+	// Detaches the reaction from the graph for good; it never runs again.
+	void dispose() {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		unsubscribeFromTriggeringProperties();
+		context.deferred.remove(this);
+		if (context.flushing)
+			context.forgetQueueLinks();
+		dirtImmune = true;
+	}
+
+	// Used in error messages and by GraphInspector; the string is not copied.
+	void setName(const char* name) {
+		this->name = name;
+	}
+
+	const char* getName() const {
+		return name;
+	}
+
+private:
+	virtual PropertyBase* makeDirty(Freshness freshness) override {
+		if (dirtImmune)
+			return nullptr;
+		if (freshness > this->freshness)
+			this->freshness = freshness;
+
+		ReactiveContext& context = ReactiveContext::get();
+		if (queueIndex == DeferredQueue::notQueued) {
+			queuedBy = context.flushing;
+			queuedThrough = context.dirtiedThrough;
+			queuedInEpoch = context.queueLinkEpoch;
+		}
+		context.deferred.push(this);
+		return nullptr;
+	}
+
+	void execute() {
+		ReactiveContext& context = ReactiveContext::get();
+		ValueGuard<ReactionBase*> g(context.current);
+		context.current = this;
+#if DECLARATIVE_INSTRUMENTATION
+		context.statistics.reactionRuns++;
+		ExecutionTimer timer(statistics);
+#endif
+
+		beginTracking();
+		function();
+		endTracking();
+	}
+
+	void run() {
+		if (freshness == Freshness::Check && !sourcesChanged()) {
+			freshness = Freshness::Clean;
+			return;
+		}
+		execute();
+	}
+
+	void checkReentry(ReactiveContext& context);
+	static void executeInParallel(ReactiveContext& context, std::vector<Reaction*>& batch);
+
+	// Runs queued reactions until none are left or the deadline has passed, though always at
+	// least one so a frame budget smaller than a single reaction still makes progress.
+	static void flush(ReactiveContext& context, std::chrono::steady_clock::time_point deadline, [[maybe_unused]] const char* traceName) {
+		DeferredQueue& deferred = context.deferred;
+		++context.lastFlushId;
+		++context.queueLinkEpoch;
+		bool started = false;
+#if DECLARATIVE_INSTRUMENTATION
+		context.statistics.flushes++;
+		unsigned long long iterationsBefore = context.statistics.flushIterations;
+#endif
+		while (!deferred.empty()) {
+			if (started && deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= deadline)
+				break;
+			started = true;
+
+			Reaction* reaction = deferred.pop();
+			reaction->checkReentry(context);
+#if DECLARATIVE_INSTRUMENTATION
+			context.statistics.flushIterations++;
+#endif
+
+			if (context.parallelFlush && reaction->pure) {
+				std::vector<Reaction*>& batch = context.parallelBatch;
+				batch.assign(1, reaction);
+				while (!deferred.empty() && deferred.top()->pure && deferred.top()->rank == reaction->rank) {
+					batch.push_back(deferred.pop());
+					batch.back()->checkReentry(context);
+#if DECLARATIVE_INSTRUMENTATION
+					context.statistics.flushIterations++;
+#endif
+				}
+				if (batch.size() > 1) {
+					executeInParallel(context, batch);
+					continue;
+				}
+			}
+
+			context.flushing = reaction;
+			reaction->run();
+			context.flushing = nullptr;
+		}
+
+#if DECLARATIVE_INSTRUMENTATION
+		if (context.traceHook) {
+			auto now = std::chrono::steady_clock::now();
+			context.traceHook({ traceName, context.transactionStart, now - context.transactionStart, context.statistics.flushIterations - iterationsBefore });
+		}
+#endif
+	}
+
+public:
+	class DeferredGuard {
+		ReactiveContext& context;
+		int uncaughtExceptions = std::uncaught_exceptions();
+
+	public:
+		DeferredGuard(ReactiveContext& context = ReactiveContext::get()) : context(context) {
+#if DECLARATIVE_INSTRUMENTATION
+			if (context.transactionDepth == 0 && context.traceHook)
+				context.transactionStart = std::chrono::steady_clock::now();
+#endif
+			context.transactionDepth++;
+		}
+
+		DeferredGuard(const DeferredGuard&) = delete;
+
+		// Throws CyclicBindingError, or whatever a reaction throws; the pending reactions are
+		// dropped first, so the context is usable again afterwards.
+		~DeferredGuard() noexcept(false) {
+			// The outermost guard stays open while it flushes, so guards taken by the
+			// reactions it runs just add to the queue it is draining. Under frame scheduling
+			// nothing is flushed here at all.
+			if (context.transactionDepth > 1 || context.frameScheduling) {
+				context.transactionDepth--;
+				return;
+			}
+
+			// Flushing while an exception unwinds through the guard could only end in terminate.
+			if (std::uncaught_exceptions() > uncaughtExceptions) {
+				context.abandonTransaction();
+				return;
+			}
+
+			try {
+				flush(context, std::chrono::steady_clock::time_point::max(), "transaction");
+			}
+			catch (...) {
+				context.abandonTransaction();
+				throw;
+			}
+			context.transactionDepth = 0;
+		}
+	};
+};
+
+// Each slot of the pool runs its share of the batch in a worker context of its own, so
+// every thread has its own current tracker. Anything a reaction queues anyway is handed
+// back to the flushing context once the batch is done.
+inline void Reaction::executeInParallel(ReactiveContext& context, std::vector<Reaction*>& batch) {
+	WorkStealingPool& pool = *context.parallelFlush;
+	while (context.workerContexts.size() < pool.slots()) {
+		context.workerContexts.push_back(std::make_unique<ReactiveContext>());
+	}
+
+	std::recursive_mutex mutex;
+	for (auto& worker : context.workerContexts) {
+		worker->graphMutex = &mutex;
+		worker->transactionDepth = 1;
+	}
+
+	std::exception_ptr error;
+	WorkStealingPool::Task task = [&](size_t index, size_t slot) {
+		ReactiveContext::Scope scope(*context.workerContexts[slot]);
+		try {
+			batch[index]->run();
+		}
+		catch (...) {
+			std::lock_guard lock(mutex);
+			if (!error)
+				error = std::current_exception();
+		}
+	};
+	pool.run(batch.size(), task);
+
+	for (auto& worker : context.workerContexts) {
+		while (!worker->deferred.empty()) {
+			context.deferred.push(worker->deferred.pop());
+		}
+		worker->graphMutex = nullptr;
+		worker->transactionDepth = 0;
+#if DECLARATIVE_INSTRUMENTATION
+		context.statistics += worker->statistics;
+		worker->statistics = {};
+#endif
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+inline size_t ReactiveContext::runPosted() {
+	if (posted.empty())
+		return 0;
+
+	size_t count = 0;
+	Reaction::DeferredGuard guard(*this);
+	while (SubmissionQueue::Node* node = posted.pop()) {
+		std::unique_ptr<SubmissionQueue::Node> owned(node);
+		node->run();
+		count++;
+	}
+	return count;
+}
+
+inline size_t ReactiveContext::runFrame(std::chrono::nanoseconds budget) {
+	if (transactionDepth > 0)
+		return deferred.size();
+	runPosted();
+
+	auto start = std::chrono::steady_clock::now();
+	auto deadline = std::chrono::steady_clock::time_point::max();
+	if (budget < deadline - start)
+		deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget);
+
+#if DECLARATIVE_INSTRUMENTATION
+	transactionStart = start;
+#endif
+	transactionDepth = 1;
+	try {
+		Reaction::flush(*this, deadline, "frame");
+	}
+	catch (...) {
+		abandonTransaction();
+		throw;
+	}
+	transactionDepth = 0;
+	return deferred.size();
+}
+
+inline void ReactiveContext::abandonTransaction() {
+	transactionDepth = 0;
+	flushing = nullptr;
+	deferred.clear();
+}
+
+inline bool DeferredQueue::before(const Reaction* a, const Reaction* b) {
+	if (a->rank != b->rank)
+		return a->rank < b->rank;
+	return a->queueSequence < b->queueSequence;
+}
+
+inline void DeferredQueue::place(Reaction* reaction, size_t index) {
+	heap[index] = reaction;
+	reaction->queueIndex = index;
+}
+
+inline void DeferredQueue::siftUp(size_t index) {
+	Reaction* reaction = heap[index];
+	while (index > 0) {
+		size_t parent = (index - 1) / 2;
+		if (!before(reaction, heap[parent]))
+			break;
+		place(heap[parent], index);
+		index = parent;
+	}
+	place(reaction, index);
+}
+
+inline void DeferredQueue::siftDown(size_t index) {
+	Reaction* reaction = heap[index];
+	for (;;) {
+		size_t child = index * 2 + 1;
+		if (child >= heap.size())
+			break;
+		if (child + 1 < heap.size() && before(heap[child + 1], heap[child]))
+			child++;
+		if (!before(heap[child], reaction))
+			break;
+		place(heap[child], index);
+		index = child;
+	}
+	place(reaction, index);
+}
+
+inline void DeferredQueue::push(Reaction* reaction) {
+	if (reaction->queueIndex != notQueued)
+		return;
+	reaction->queueSequence = ++lastSequence;
+	heap.push_back(reaction);
+	siftUp(heap.size() - 1);
+}
+
+inline Reaction* DeferredQueue::pop() {
+	Reaction* top = heap.front();
+	top->queueIndex = notQueued;
+	Reaction* last = heap.back();
+	heap.pop_back();
+	if (!heap.empty()) {
+		heap[0] = last;
+		siftDown(0);
+	}
+	return top;
+}
+
+inline void DeferredQueue::remove(Reaction* reaction) {
+	size_t index = reaction->queueIndex;
+	if (index == notQueued)
+		return;
+	reaction->queueIndex = notQueued;
+	Reaction* last = heap.back();
+	heap.pop_back();
+	if (index < heap.size()) {
+		heap[index] = last;
+		siftUp(index);
+		siftDown(last->queueIndex);
+	}
+}
+
+inline void DeferredQueue::rankRaised(Reaction* reaction) {
+	if (reaction->queueIndex != notQueued)
+		siftDown(reaction->queueIndex);
+}
+
+inline void DeferredQueue::clear() {
+	for (auto reaction : heap) {
+		reaction->queueIndex = notQueued;
+	}
+	heap.clear();
+}
+
+// Runs function with every write it makes coalesced: dependents are only dirtied along the
+// way and the reactions they reach run once, when the outermost transaction ends.
+template<typename Function>
+decltype(auto) transaction(Function&& function) {
+	Reaction::DeferredGuard _;
+	return std::forward<Function>(function)();
+}
+
+// Tears down several nodes in one call, e.g. all the Declarative members of an object before
+// the rest of it goes away. Each one costs as many steps as it has edges.
+template<typename... Nodes>
+void dispose(Nodes&... nodes) {
+	(nodes.dispose(), ...);
+}
+
+// Runs function without the reads it makes becoming dependencies of the running reaction,
+// so it is not re-run when they change. Whatever is read is still brought up to date.
+template<typename Function>
+decltype(auto) untracked(Function&& function) {
+	ReactiveContext& context = ReactiveContext::get();
+	ValueGuard<ReactionBase*> _(context.current);
+	context.current = nullptr;
+	return std::forward<Function>(function)();
+}
+
+class PropertyBase {
+	friend class ReactionBase;
+	friend class Reaction;
+	friend class GraphSnapshot;
+	friend class GraphInspector;
+protected:
+	const char* name = nullptr;
+	Dependency* firstDependent = nullptr;
+	Dependency* lastDependent = nullptr;
+	// The edge of the reader that recorded a read of it last, so reading it again in the same
+	// run is a single compare. Cleared when that edge is released.
+	Dependency* lastTracked = nullptr;
+	unsigned height = 0;
+	// Bumped whenever the value actually changes; edges remember the version they last saw.
+	unsigned long long version = 0;
+	// Keeps the context it was built in alive for as long as the node is.
+	DependencyPool::Handle contextHandle{ ReactiveContext::get().dependencyPool };
+
+	// Brings a computed value up to date without subscribing anyone to it.
+	virtual void refresh() {}
+	// The reaction side, while refresh() would first have to find out whether any source
+	// really changed.
+	virtual ReactionBase* pendingValidation() { return nullptr; }
+	// Called when the last dependent goes away.
+	virtual void unobserved() {}
+
+	// The node's reaction side, if it is computed.
+	virtual ReactionBase* reactionSide() { return nullptr; }
+
+	// What a GraphSnapshot needs from the concrete node: the type of its value and the value
+	// as stored by SnapshotTraits. With compare set, decodeValue() reports whether data equals
+	// the value instead of assigning it.
+	virtual size_t snapshotType() const { return 0; }
+	virtual bool encodeValue(std::string&) { return false; }
+	virtual bool decodeValue(const std::string&, bool) { return false; }
+
+	void detachDependents();
+	void rankAfter(ReactiveContext& context, ReactionBase* writer);
+
+	// Subscribes the running reaction, if there is one, to this node.
+	void track(ReactiveContext& context) {
+		if (context.current)
+			context.current->addTriggeringProperty(this);
+	}
+
+	// Records that the value really changed and dirties the dependents, flushing right away
+	// unless a transaction is open.
+	void valueChanged(ReactiveContext& context) {
+		version++;
+
+		// Inside a transaction there is nothing to flush yet, so skip the guard entirely.
+		if (context.transactionDepth > 0) {
+			makeDependentReactionsDirty(Freshness::Dirty);
+			return;
+		}
+		Reaction::DeferredGuard _(context);
+		makeDependentReactionsDirty(Freshness::Dirty);
+	}
+
+public:
+	PropertyBase() = default;
+
+	PropertyBase(const PropertyBase&) = delete;
+
+	virtual ~PropertyBase() {
+		detachDependents();
+	}
+
+	void makeDependentReactionsDirty(Freshness freshness);
+
+	// Used in error messages and by GraphInspector; the string is not copied.
+	void setName(const char* name) {
+		this->name = name;
+	}
+
+	const char* getName() const {
+		return name;
+	}
+
+private:
+	void appendDependent(Dependency* dependency) {
+		dependency->prevDependent = lastDependent;
+		dependency->nextDependent = nullptr;
+		if (lastDependent)
+			lastDependent->nextDependent = dependency;
+		else
+			firstDependent = dependency;
+		lastDependent = dependency;
+	}
+
+	void removeDependent(Dependency* dependency) {
+		if (dependency->prevDependent)
+			dependency->prevDependent->nextDependent = dependency->nextDependent;
+		else
+			firstDependent = dependency->nextDependent;
+		if (dependency->nextDependent)
+			dependency->nextDependent->prevDependent = dependency->prevDependent;
+		else
+			lastDependent = dependency->prevDependent;
+	}
+};
+
+// Walks the downstream cone with an explicit stack, so chain depth is only bounded by memory,
+// as it is for the validation in sourcesChanged(). Only the first evaluation of a chain still
+// nests one call per level. Direct dependents get the given freshness, everything past them
+// Check.
+inline void PropertyBase::makeDependentReactionsDirty(Freshness freshness) {
+	ReactiveContext& context = ReactiveContext::get();
+	std::vector<PropertyBase*>& stack = context.propagationStack;
+	size_t bottom = stack.size();
+
+	stack.push_back(this);
+	while (stack.size() > bottom) {
+		PropertyBase* property = stack.back();
+		stack.pop_back();
+		context.dirtiedThrough = property;
+		for (auto dependency = property->firstDependent; dependency; dependency = dependency->nextDependent) {
+			ReactionBase* reaction = dependency->reaction;
+			// The running reaction's edges from its previous run stay linked until the run
+			// ends; one not read again yet is no reason to queue it again.
+			bool running = reaction == context.current || reaction == context.flushing;
+			if (running && dependency->epoch != reaction->trackingEpoch)
+				continue;
+			if (PropertyBase* next = reaction->makeDirty(freshness))
+				stack.push_back(next);
+		}
+		freshness = Freshness::Check;
+	}
+}
+
+// For a property written by writer: raises its height to the writer's rank, and the ranks of
+// everything downstream with it, moving reactions already queued back. The dependents form
+// no cycles, so this ends once every rank is high enough.
+inline void PropertyBase::rankAfter(ReactiveContext& context, ReactionBase* writer) {
+	unsigned writerRank = writer->rankSoFar();
+	if (writerRank <= height)
+		return;
+	height = writerRank;
+	std::vector<PropertyBase*>& stack = context.propagationStack;
+	size_t bottom = stack.size();
+
+	stack.push_back(this);
+	while (stack.size() > bottom) {
+		PropertyBase* property = stack.back();
+		stack.pop_back();
+		for (auto dependency = property->firstDependent; dependency; dependency = dependency->nextDependent) {
+			ReactionBase* reaction = dependency->reaction;
+			if (reaction->rank > property->height)
+				continue;
+			reaction->rank = property->height + 1;
+			if (Reaction* queued = dynamic_cast<Reaction*>(reaction))
+				context.deferred.rankRaised(queued);
+			PropertyBase* next = reaction->propertySide();
+			if (next && next->height < reaction->rank) {
+				next->height = reaction->rank;
+				stack.push_back(next);
+			}
+		}
+	}
+}
+
+// Each edge is unlinked from both of its lists directly, so this costs one step per
+// dependent whatever the size of the graph.
+inline void PropertyBase::detachDependents() {
+	ReactiveContext& context = ReactiveContext::get();
+	GraphLock lock(context);
+	Dependency* dependency = firstDependent;
+	firstDependent = nullptr;
+	lastDependent = nullptr;
+	lastTracked = nullptr;
+	while (dependency) {
+		Dependency* next = dependency->nextDependent;
+		ReactionBase* reaction = dependency->reaction;
+		if (reaction->trackingCursor == dependency)
+			reaction->trackingCursor = dependency->prevTrigger;
+		reaction->removeTrigger(dependency);
+		reaction->dependencyPool->release(dependency);
+#if DECLARATIVE_INSTRUMENTATION
+		context.statistics.edgesRemoved++;
+#endif
+		dependency = next;
+	}
+	if (context.flushing)
+		context.forgetQueueLinks();
+}
+
+// Called as a reaction is taken off the queue. The first run in a flush is always fine; for
+// a later one, following who queued it back through the reactions run since leads to itself
+// exactly when its own run caused it to be queued again.
+inline void Reaction::checkReentry(ReactiveContext& context) {
+	unsigned long long flushId = context.lastFlushId;
+	if (this->flushId != flushId) {
+		this->flushId = flushId;
+		runsInFlush = 1;
+		return;
+	}
+	runsInFlush++;
+
+	auto describe = [](const char* kind, const char* name, const void* address) {
+		std::ostringstream stream;
+		stream << kind << ' ';
+		if (name)
+			stream << '\'' << name << '\'';
+		else
+			stream << address;
+		return stream.str();
+	};
+
+	unsigned long long epoch = context.queueLinkEpoch;
+	unsigned long long walk = ++context.lastCycleWalk;
+	for (Reaction* node = this; node->queuedInEpoch == epoch && node->queuedBy; node = node->queuedBy) {
+		// A loop that does not pass through this reaction is reported when one of its own
+		// members comes up again.
+		if (node->cycleWalk == walk)
+			break;
+		node->cycleWalk = walk;
+		if (node->queuedBy != this)
+			continue;
+
+		// Collected against the direction the change travelled, then turned around.
+		std::vector<std::string> chain;
+		Reaction* link = this;
+		do {
+			chain.push_back(describe("reaction", link->name, link));
+			if (link->queuedThrough)
+				chain.push_back(describe("property", link->queuedThrough->name, link->queuedThrough));
+			link = link->queuedBy;
+		} while (link != this);
+		chain.push_back(describe("reaction", name, this));
+		std::reverse(chain.begin(), chain.end());
+
+		throw CyclicBindingError(std::move(chain));
+	}
+
+	// The links were lost, e.g. to nodes destroyed along the way, so all that is known is
+	// that this reaction keeps coming back.
+	if (runsInFlush > context.reentryLimit)
+		throw CyclicBindingError({ describe("reaction", name, this), describe("reaction", name, this) });
+}
+
+// Triggers are kept in the order they were read. While a reaction runs, trackingCursor
+// points at the last trigger confirmed in this run: reads that follow the previous run's
+// order just move the cursor forward, and whatever is left behind it when the run ends
+// was not read again and is dropped.
+inline void ReactionBase::beginTracking() {
+	trackingCursor = nullptr;
+	freshness = Freshness::Clean;
+	if (++trackingEpoch == 0)
+		++trackingEpoch;
+}
+
+inline void ReactionBase::endTracking() {
+	GraphLock lock(ReactiveContext::get());
+
+	Dependency* stale = trackingCursor ? trackingCursor->nextTrigger : firstTrigger;
+
+	rank = 0;
+	for (Dependency* dependency = firstTrigger; dependency != stale; dependency = dependency->nextTrigger) {
+		if (dependency->property->height >= rank)
+			rank = dependency->property->height + 1;
+	}
+
+	if (!stale) return;
+
+	if (trackingCursor)
+		trackingCursor->nextTrigger = nullptr;
+	else
+		firstTrigger = nullptr;
+	lastTrigger = trackingCursor;
+
+	releaseTriggersFrom(stale);
+}
+
+// The rank a running reaction has at least, given what it read so far and its previous run.
+inline unsigned ReactionBase::rankSoFar() const {
+	unsigned result = rank;
+	for (Dependency* dependency = trackingCursor ? firstTrigger : nullptr; dependency; dependency = dependency->nextTrigger) {
+		if (dependency->property->height >= result)
+			result = dependency->property->height + 1;
+		if (dependency == trackingCursor)
+			break;
+	}
+	return result;
+}
+
+inline void ReactionBase::addTriggeringProperty(PropertyBase* property) {
+	ReactiveContext& context = ReactiveContext::get();
+	// Worker threads of a parallel batch may read the same property at once, so they leave
+	// the stamp alone.
+	bool stamping = !context.graphMutex;
+	Dependency* stamped = stamping ? property->lastTracked : nullptr;
+	if (stamped && stamped->reaction == this && stamped->epoch == trackingEpoch) {
+		stamped->observedVersion = property->version;
+#if DECLARATIVE_INSTRUMENTATION
+		statistics.repeatedReads++;
+#endif
+		return;
+	}
+
+	if (trackingCursor && trackingCursor->property == property) {
+		trackingCursor->observedVersion = property->version;
+#if DECLARATIVE_INSTRUMENTATION
+		statistics.repeatedReads++;
+#endif
+		if (stamping)
+			property->lastTracked = trackingCursor;
+		return;
+	}
+
+	Dependency* next = trackingCursor ? trackingCursor->nextTrigger : firstTrigger;
+	if (next && next->property == property) {
+		next->epoch = trackingEpoch;
+		next->observedVersion = property->version;
+		trackingCursor = next;
+		if (stamping)
+			property->lastTracked = next;
+		return;
+	}
+
+	GraphLock lock(context);
+
+	// The stamp only remembers the last reader, so a duplicate edge can still slip through
+	// when reads of other nodes interleave; that is harmless since makeDirty() is idempotent.
+	Dependency* dependency = stamped && stamped->reaction == this ? stamped : property->lastDependent;
+	if (dependency && dependency->reaction == this) {
+		if (dependency->epoch == trackingEpoch) {
+			dependency->observedVersion = property->version;
+#if DECLARATIVE_INSTRUMENTATION
+			statistics.repeatedReads++;
+#endif
+			return;
+		}
+		// Read in the previous run but in a different order: move it instead of reallocating.
+		removeTrigger(dependency);
+	}
+	else {
+		dependency = dependencyPool->allocate();
+#if DECLARATIVE_INSTRUMENTATION
+		context.statistics.edgesAdded++;
+#endif
+		dependency->property = property;
+		dependency->reaction = this;
+		property->appendDependent(dependency);
+	}
+
+	dependency->epoch = trackingEpoch;
+	dependency->observedVersion = property->version;
+	insertTriggerAfterCursor(dependency);
+	trackingCursor = dependency;
+	if (stamping)
+		property->lastTracked = dependency;
+}
+
+// Being dirtied only means a source may have changed. Sources are brought up to date in
+// the order they were read, stopping at the first one whose value is really different.
+// A source that needs the same check is descended into on an explicit stack rather than
+// through refresh(), so a long chain of Check nodes does not use up the call stack; by the
+// time it is refreshed all of its own sources are settled and refresh() stays shallow.
+inline bool ReactionBase::sourcesChanged() {
+	ReactiveContext& context = ReactiveContext::get();
+	GraphLock lock(context);
+	// Refreshing runs code that may validate on the same stack, so frames are only ever
+	// accessed by index.
+	auto& stack = context.validationStack;
+	size_t bottom = stack.size();
+	stack.emplace_back(this, firstTrigger);
+
+	for (;;) {
+		size_t top = stack.size() - 1;
+		auto [reaction, dependency] = stack[top];
+		if (dependency) {
+			PropertyBase* property = dependency->property;
+			if (ReactionBase* source = property->pendingValidation()) {
+				stack.emplace_back(source, source->firstTrigger);
+				continue;
+			}
+			property->refresh();
+			if (property->version == dependency->observedVersion) {
+				stack[top].second = dependency->nextTrigger;
+				continue;
+			}
+		}
+
+		// Either all sources of reaction are unchanged or this one is not.
+		stack.pop_back();
+		if (top == bottom)
+			return dependency != nullptr;
+		// With its sources settled, refreshing the node re-checks them in one shallow pass.
+		stack[top - 1].second->property->refresh();
+	}
+}
+
+// For nodes with fixed triggers that execute without tracking: records the versions just
+// read and the resulting rank, as a tracked run would have.
+inline void ReactionBase::restampTriggers() {
+	GraphLock lock(ReactiveContext::get());
+	rank = 0;
+	for (Dependency* dependency = firstTrigger; dependency; dependency = dependency->nextTrigger) {
+		dependency->observedVersion = dependency->property->version;
+		if (dependency->property->height >= rank)
+			rank = dependency->property->height + 1;
+	}
+}
+
+inline void ReactionBase::unsubscribeFromTriggeringProperties() {
+	Dependency* dependency = firstTrigger;
+	firstTrigger = nullptr;
+	lastTrigger = nullptr;
+	trackingCursor = nullptr;
+	releaseTriggersFrom(dependency);
+}
+
+inline void ReactionBase::insertTriggerAfterCursor(Dependency* dependency) {
+	Dependency* next = trackingCursor ? trackingCursor->nextTrigger : firstTrigger;
+
+	dependency->prevTrigger = trackingCursor;
+	dependency->nextTrigger = next;
+	if (trackingCursor)
+		trackingCursor->nextTrigger = dependency;
+	else
+		firstTrigger = dependency;
+	if (next)
+		next->prevTrigger = dependency;
+	else
+		lastTrigger = dependency;
+}
+
+inline void ReactionBase::removeTrigger(Dependency* dependency) {
+	if (dependency->prevTrigger)
+		dependency->prevTrigger->nextTrigger = dependency->nextTrigger;
+	else
+		firstTrigger = dependency->nextTrigger;
+	if (dependency->nextTrigger)
+		dependency->nextTrigger->prevTrigger = dependency->prevTrigger;
+	else
+		lastTrigger = dependency->prevTrigger;
+}
+
+inline void ReactionBase::releaseTriggersFrom(Dependency* dependency) {
+#if DECLARATIVE_INSTRUMENTATION
+	GraphStatistics& graphStatistics = ReactiveContext::get().statistics;
+#endif
+	while (dependency) {
+#if DECLARATIVE_INSTRUMENTATION
+		graphStatistics.edgesRemoved++;
+#endif
+		Dependency* next = dependency->nextTrigger;
+		PropertyBase* property = dependency->property;
+		property->removeDependent(dependency);
+		if (property->lastTracked == dependency)
+			property->lastTracked = nullptr;
+		dependencyPool->release(dependency);
+		if (!property->firstDependent)
+			property->unobserved();
+		dependency = next;
+	}
+}
+
+// Sources that end up unobserved in turn are suspended by the same loop instead of recursing.
+inline void ReactionBase::suspend() {
+	ReactiveContext& context = ReactiveContext::get();
+	context.suspensionStack.push_back(this);
+	if (context.suspending)
+		return;
+
+	context.suspending = true;
+	while (!context.suspensionStack.empty()) {
+		ReactionBase* node = context.suspensionStack.back();
+		context.suspensionStack.pop_back();
+		node->freshness = Freshness::Dirty;
+		node->unsubscribeFromTriggeringProperties();
+	}
+	context.suspending = false;
+}
+
+
+
+template <typename T>
+class Property:  PropertyBase,  ReactionBase {
+	template<typename> friend class Property;
+	template<typename, typename, typename> friend class ComputedFamily;
+	friend class GraphInspector;
+public:
+	using Function = InplaceFunction<T()>;
+	//using FunctionThis = std::function<const T& (Property& property)>;
+	// Decides whether a new value is a change worth propagating; null always propagates.
+	using Equality = bool(*)(const T& a, const T& b);
+
+	static constexpr Equality defaultEquality() {
+		if constexpr (std::equality_comparable<T>)
+			return [](const T& a, const T& b) { return a == b; };
+		else
+			return nullptr;
+	}
+
+private:
+	T value = {};
+	Function function = {};
+	Equality equality = defaultEquality();
+	Evaluation evaluation = Evaluation::Lazy;
+	std::unique_ptr<Reaction> eagerObserver;
+	bool tracked = true;
+	bool executionInProgress = false;
+	// Set when an update threw: readers may have missed the change, so the next dirtying is
+	// passed on to them although the node is already dirty.
+	bool updateThrew = false;
+	std::pmr::vector<ReactionBase*> reactionsWhoReceivedOldValue{ dependencyPool->resource() };
+	
+	T execute() {
+		ReactiveContext& context = ReactiveContext::get();
+		ValueGuard<ReactionBase*> g(context.current);
+#if DECLARATIVE_INSTRUMENTATION
+		context.statistics.recomputes++;
+		ExecutionTimer timer(statistics);
+#endif
+
+		if (!tracked) {
+			context.current = nullptr;
+			T result = function();
+			restampTriggers();
+			height = rank;
+			return result;
+		}
+
+		context.current = this;
+
+		beginTracking();
+		try {
+			T result = function();
+			endTracking();
+			height = rank;
+			return result;
+		}
+		catch (...) {
+			// Keeps what was read before the throw, so changes to it still reach the node.
+			endTracking();
+			throw;
+		}
+	}
+
+protected:
+	// Binds a function whose sources are known up front: they are subscribed to once, here,
+	// and executing it no longer goes through dependency tracking at all.
+	template<typename... TSources>
+	void setStaticFunction(Function function, Property<TSources>&... sources) {
+		GraphLock lock(ReactiveContext::get());
+		unsubscribeFromTriggeringProperties();
+		this->function = std::move(function);
+		tracked = false;
+
+		Freshness previous = freshness;
+		beginTracking();
+		(addTriggeringProperty(&sources), ...);
+		endTracking();
+		freshness = previous;
+		height = rank;
+
+		Reaction::DeferredGuard _;
+		if (makeDirty(Freshness::Dirty))
+			makeDependentReactionsDirty(Freshness::Check);
+	}
+
+public:	
+	const T& getValue() {
+		ReactiveContext& context = ReactiveContext::get();
+		// Plain reads of an up to date value, outside any reaction or parallel batch.
+		if (!context.current && !context.graphMutex && freshness == Freshness::Clean)
+			return value;
+
+		GraphLock lock(context);
+
+		if (freshness != Freshness::Clean) {
+			if (executionInProgress) {
+				if (!context.current)
+					return value;
+				context.current->addTriggeringProperty(this);
+				if (std::find(reactionsWhoReceivedOldValue.begin(), reactionsWhoReceivedOldValue.end(), context.current) == reactionsWhoReceivedOldValue.end())
+					reactionsWhoReceivedOldValue.push_back(context.current);
+				return value;
+			}
+
+			update();
+			if (!context.current && evaluation == Evaluation::AutoSuspend && !firstDependent)
+				suspend();
+		}
+
+		track(context);
+		return value;
+	}
+
+	// Detaches the property from everything it reads and everything reading it. It keeps its
+	// current value, now as a plain value.
+	void dispose() {
+		GraphLock lock(ReactiveContext::get());
+		eagerObserver.reset();
+		unsubscribeFromTriggeringProperties();
+		detachDependents();
+		function = {};
+		tracked = true;
+		evaluation = Evaluation::Lazy;
+		freshness = Freshness::Clean;
+	}
+
+	// Reads the value without subscribing the running reaction to it.
+	const T& peek() {
+		return untracked([this]() -> const T& { return getValue(); });
+	}
+
+	void setEvaluation(Evaluation evaluation) {
+		GraphLock lock(ReactiveContext::get());
+		this->evaluation = evaluation;
+
+		if (evaluation == Evaluation::Eager) {
+			if (!eagerObserver)
+				eagerObserver = std::make_unique<Reaction>([this]() { getValue(); });
+			return;
+		}
+
+		eagerObserver.reset();
+		if (evaluation == Evaluation::AutoSuspend && !firstDependent && function)
+			suspend();
+	}
+
+	void setEquality(Equality equality) {
+		this->equality = equality;
+	}
+
+	using PropertyBase::setName;
+	using PropertyBase::getName;
+
+#if DECLARATIVE_INSTRUMENTATION
+	using ReactionBase::getStatistics;
+#endif
+
+	void setFunction(Function function) {
+
+		GraphLock lock(ReactiveContext::get());
+		unsubscribeFromTriggeringProperties();
+		this->function = std::move(function);
+		tracked = true;
+
+		Reaction::DeferredGuard _;
+		if (makeDirty(Freshness::Dirty))
+			makeDependentReactionsDirty(Freshness::Check);
+
+	}
+
+	void setValue(const T& value) {
+		assignValue(value);
+	}
+
+	void setValue(T&& value) {
+		assignValue(std::move(value));
+	}
+
+	
+private:
+	template<typename U>
+	void assignValue(U&& value) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		unsubscribeFromTriggeringProperties();
+		// The height of a binding no longer applies. One written by a reaction ranks after
+		// it instead, so what reads it waits for the writer to run.
+		if (this->function)
+			height = 0;
+		ReactionBase* writer = context.current ? context.current : context.flushing;
+		if (writer && writer != this)
+			rankAfter(context, writer);
+
+		bool changed = !equality || !equality(this->value, value);
+		this->value = std::forward<U>(value);
+		freshness = Freshness::Clean;
+		this->function = {};
+		tracked = true;
+
+		if (changed)
+			valueChanged(context);
+	}
+
+	// Reads made while executing get the current value, so it doubles as the old value the
+	// new one is compared against.
+	void update() {
+		executionInProgress = true;
+		// If validating or the binding throws, the old value stays and the next read recomputes.
+		struct Unwind {
+			Property& property;
+
+			~Unwind() {
+				if (!property.executionInProgress)
+					return;
+				property.executionInProgress = false;
+				property.freshness = Freshness::Dirty;
+				property.updateThrew = true;
+				property.reactionsWhoReceivedOldValue.clear();
+			}
+		} unwind{ *this };
+
+		if (freshness == Freshness::Check && !sourcesChanged()) {
+			executionInProgress = false;
+			freshness = Freshness::Clean;
+			reactionsWhoReceivedOldValue.clear();
+			return;
+		}
+
+		T newValue = execute();
+
+		executionInProgress = false;
+		freshness = Freshness::Clean;
+
+		bool changed = !equality || !equality(value, newValue);
+		value = std::move(newValue);
+		if (changed)
+			version++;
+#if DECLARATIVE_INSTRUMENTATION
+		else {
+			statistics.redundantExecutions++;
+			ReactiveContext::get().statistics.redundantRecomputes++;
+		}
+#endif
+
+		if (reactionsWhoReceivedOldValue.size() > 0) {
+			if (changed) {
+				Reaction::DeferredGuard _;
+				ReactiveContext::get().dirtiedThrough = this;
+				for (auto reaction : reactionsWhoReceivedOldValue) {
+					if (PropertyBase* property = reaction->makeDirty(Freshness::Dirty))
+						property->makeDependentReactionsDirty(Freshness::Check);
+				}
+			}
+			reactionsWhoReceivedOldValue.clear();
+		}
+	}
+
+	virtual void refresh() override {
+		GraphLock lock(ReactiveContext::get());
+		if (freshness != Freshness::Clean && !executionInProgress)
+			update();
+	}
+
+	virtual ReactionBase* pendingValidation() override {
+		return freshness == Freshness::Check && !executionInProgress ? this : nullptr;
+	}
+
+	virtual void unobserved() override {
+		if (evaluation == Evaluation::AutoSuspend && function && !executionInProgress)
+			suspend();
+	}
+
+
+	virtual PropertyBase* makeDirty(Freshness freshness) override {
+		if (this->freshness != Freshness::Clean) {
+			if (freshness > this->freshness)
+				this->freshness = freshness;
+			if (!updateThrew)
+				return nullptr;
+		}
+		else
+			this->freshness = freshness;
+
+		updateThrew = false;
+		return this;
+	};
+
+	virtual size_t snapshotType() const override {
+		// Hashing the type's name is not free, and it is asked for once per node.
+		static const size_t type = typeid(T).hash_code();
+		return type;
+	}
+
+	virtual ReactionBase* reactionSide() override {
+		return function ? this : nullptr;
+	}
+
+	virtual PropertyBase* propertySide() override {
+		return this;
+	}
+
+	virtual bool encodeValue(std::string& data) override {
+		if constexpr (SnapshotTraits<T>::supported) {
+			SnapshotTraits<T>::write(data, value);
+			return true;
+		}
+		else
+			return false;
+	}
+
+	virtual bool decodeValue(const std::string& data, bool compare) override {
+		if constexpr (SnapshotTraits<T>::supported) {
+			if (!compare)
+				return SnapshotTraits<T>::read(data, value);
+			T stored = {};
+			return SnapshotTraits<T>::read(data, stored) && equality && equality(value, stored);
+		}
+		else
+			return false;
+	}
+
+public:
+
+	template<typename TLambda, class enable = std::enable_if_t<std::is_same_v<T, std::invoke_result_t<TLambda&>>>>
+	Property(TLambda lambda) {
+		GraphSnapshot::enroll(this);
+		setFunction(std::move(lambda));
+	}
+
+	Property(const Property&) = delete;
+
+	Property() {
+		GraphSnapshot::enroll(this);
+	}
+
+	Property(T value) {
+		GraphSnapshot::enroll(this);
+		setValue(std::move(value));
+	}
+
+	Property(Function function) {
+		GraphSnapshot::enroll(this);
+		setFunction(std::move(function));
+	}
+
+	operator const T& () {
+		return getValue();
+	}
+
+	const void operator = (const T& value) {
+		setValue(value);
+	}
+	const void operator = (T&& value) {
+		setValue(std::move(value));
+	}
+	const void operator = (Function function) {
+		setFunction(std::move(function));
+	}
+	template<typename TLambda, class enable = std::enable_if_t<std::is_same_v<T, std::invoke_result_t<TLambda&>>>>
+	const void operator = (TLambda lambda) {
+		setFunction(std::move(lambda));
+	}
+
+};
+
+template <typename T>
+std::ostream& operator<<(std::ostream& stream, Property<T>& property){
+	stream << property.getValue();
+	return stream;
+}
+
+template<typename Member>
+struct SourceTraits;
+
+template<typename TOwner, typename TValue>
+struct SourceTraits<Property<TValue> TOwner::*> {
+	using Owner = TOwner;
+	using Value = TValue;
+};
+
+// Computed property over a fixed set of sibling members, e.g. Computed<float, &Test::PropertyA>
+// for a class with Declarative(float, A). The function is handed the source values directly;
+// the sources are subscribed to once, so updating it never touches the tracking machinery.
+template<typename T, auto Source, auto... Sources>
+class Computed : Property<T> {
+	using Owner = typename SourceTraits<decltype(Source)>::Owner;
+	friend class GraphInspector;
+
+public:
+	template<typename TLambda>
+	Computed(Owner* owner, TLambda lambda) {
+		this->setStaticFunction([owner, lambda]() -> T {
+			return lambda((owner->*Source).getValue(), (owner->*Sources).getValue()...);
+		}, owner->*Source, owner->*Sources...);
+	}
+
+	Computed(const Computed&) = delete;
+
+	using Property<T>::getValue;
+	using Property<T>::peek;
+	using Property<T>::dispose;
+	using Property<T>::setName;
+	using Property<T>::getName;
+#if DECLARATIVE_INSTRUMENTATION
+	using Property<T>::getStatistics;
+#endif
+
+	operator const T& () {
+		return getValue();
+	}
+};
+
+template <typename T, auto... Sources>
+std::ostream& operator<<(std::ostream& stream, Computed<T, Sources...>& property){
+	stream << property.getValue();
+	return stream;
+}
+
+// A computed property per key, e.g. "formatted label for row i", made the first time its
+// key is read. Recently read entries are kept, up to budget bytes, even while nothing depends
+// on them, so reading them again is free unless a source changed. Entries with dependents are
+// never evicted. An untracked caller's reference is only good until the next get().
+template<typename Key, typename T, typename Hash = std::hash<Key>>
+class ComputedFamily {
+public:
+	using Function = InplaceFunction<T(const Key&)>;
+	// Heap memory owned by a value, on top of its own size.
+	using SizeOf = size_t(*)(const T& value);
+
+private:
+	struct Entry {
+		Key key;
+		Property<T> node;
+		size_t cost = 0;
+
+		Entry(const Key& key) : key(key) {}
+	};
+
+	// Rough price of the list and index nodes that come with each entry.
+	static constexpr size_t entryOverhead = sizeof(Entry) + sizeof(Key) + 6 * sizeof(void*);
+
+	Function function;
+	size_t budget;
+	SizeOf sizeOf;
+	size_t used = 0;
+	size_t depth = 0;
+	// Most recently read first.
+	std::list<Entry> entries;
+	std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+
+	static bool pinned(Entry& entry) {
+		return entry.node.firstDependent || entry.node.executionInProgress;
+	}
+
+	void evict(const Entry* keep) {
+		size_t candidates = entries.size();
+		while (used > budget && candidates-- > 0) {
+			Entry& victim = entries.back();
+			if (&victim == keep || pinned(victim)) {
+				entries.splice(entries.begin(), entries, std::prev(entries.end()));
+				continue;
+			}
+			used -= victim.cost;
+			index.erase(victim.key);
+			entries.pop_back();
+		}
+	}
+
+public:
+	ComputedFamily(Function function, size_t budget = 1024 * 1024, SizeOf sizeOf = nullptr)
+		: function(std::move(function)), budget(budget), sizeOf(sizeOf) {}
+
+	ComputedFamily(const ComputedFamily&) = delete;
+
+	const T& get(const Key& key) {
+		GraphLock lock(ReactiveContext::get());
+
+		auto found = index.find(key);
+		if (found == index.end()) {
+			GraphSnapshot::excluded([&] { entries.emplace_front(key); });
+			Entry& entry = entries.front();
+			entry.node.setFunction([this, &entry]() { return function(entry.key); });
+			entry.cost = entryOverhead;
+			used += entry.cost;
+			found = index.emplace(key, entries.begin()).first;
+		}
+		else if (found->second != entries.begin()) {
+			entries.splice(entries.begin(), entries, found->second);
+		}
+		Entry& entry = *found->second;
+
+		const T* value;
+		{
+			// Entries read by the function itself get read inside this call; eviction waits
+			// for the outermost one.
+			ValueGuard<size_t> g(depth);
+			depth++;
+			value = &entry.node.getValue();
+		}
+
+		if (sizeOf) {
+			size_t cost = entryOverhead + sizeOf(*value);
+			used = used - entry.cost + cost;
+			entry.cost = cost;
+		}
+		if (depth == 0)
+			evict(&entry);
+		return *value;
+	}
+
+	const T& operator()(const Key& key) {
+		return get(key);
+	}
+
+	void setBudget(size_t budget) {
+		this->budget = budget;
+		if (depth == 0)
+			evict(nullptr);
+	}
+
+	size_t size() const {
+		return entries.size();
+	}
+
+	size_t memoryUsed() const {
+		return used;
+	}
+};
+
+namespace SnapshotFormat {
+	constexpr char magic[4] = { 'D', 'G', 'S', '1' };
+
+	template<typename T>
+	void write(std::ostream& stream, const T& value) {
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	bool read(std::istream& stream, T& value) {
+		return bool(stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+}
+
+// Layout: the magic, the node count, then per node its type, kind flags, height, version,
+// stored value and edges, all in native byte order. A snapshot is only meant to be read by
+// the build that wrote it.
+inline void GraphSnapshot::save(std::ostream& stream) {
+	std::unordered_map<PropertyBase*, unsigned> indices;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i].property)
+			indices.emplace(nodes[i].property, unsigned(i));
+	}
+
+	stream.write(SnapshotFormat::magic, sizeof(SnapshotFormat::magic));
+	SnapshotFormat::write(stream, static_cast<unsigned long long>(nodes.size()));
+	std::string value;
+	std::vector<std::pair<unsigned, unsigned long long>> edges;
+	for (Node& node : nodes) {
+		ReactionBase* reaction = node.reaction ? node.reaction : node.property->reactionSide();
+		size_t type = node.property ? node.property->snapshotType() : 0;
+		bool complete = !reaction || reaction->freshness == Freshness::Clean;
+
+		edges.clear();
+		for (Dependency* dependency = reaction ? reaction->firstTrigger : nullptr; complete && dependency; dependency = dependency->nextTrigger) {
+			auto found = indices.find(dependency->property);
+			if (found == indices.end())
+				complete = false;
+			else
+				edges.emplace_back(found->second, dependency->observedVersion);
+		}
+		if (!complete)
+			edges.clear();
+
+		value.clear();
+		bool hasValue = node.property && complete && node.property->encodeValue(value);
+
+		unsigned char flags = (node.reaction ? 1 : 0) | (reaction && node.property ? 2 : 0) | (complete ? 4 : 0) | (hasValue ? 8 : 0);
+		SnapshotFormat::write(stream, type);
+		SnapshotFormat::write(stream, flags);
+		SnapshotFormat::write(stream, node.property ? node.property->height : 0u);
+		SnapshotFormat::write(stream, node.property ? node.property->version : 0ull);
+		SnapshotFormat::write(stream, unsigned(value.size()));
+		stream.write(value.data(), value.size());
+		SnapshotFormat::write(stream, unsigned(edges.size()));
+		for (auto& [index, observedVersion] : edges) {
+			SnapshotFormat::write(stream, index);
+			SnapshotFormat::write(stream, observedVersion);
+		}
+	}
+}
+
+inline bool GraphSnapshot::load(std::istream& stream) {
+	records.clear();
+	restoring = false;
+
+	char magic[sizeof(SnapshotFormat::magic)];
+	unsigned long long count;
+	if (!stream.read(magic, sizeof(magic)) || std::memcmp(magic, SnapshotFormat::magic, sizeof(magic)) != 0 || !SnapshotFormat::read(stream, count))
+		return false;
+
+	records.resize(count);
+	for (Record& record : records) {
+		unsigned char flags;
+		unsigned size, edgeCount;
+		if (!SnapshotFormat::read(stream, record.type) || !SnapshotFormat::read(stream, flags) || !SnapshotFormat::read(stream, record.height)
+			|| !SnapshotFormat::read(stream, record.version) || !SnapshotFormat::read(stream, size)) {
+			records.clear();
+			return false;
+		}
+		record.reaction = flags & 1;
+		record.computed = flags & 2;
+		record.complete = flags & 4;
+		record.hasValue = flags & 8;
+		record.value.resize(size);
+		if (!stream.read(record.value.data(), size) || !SnapshotFormat::read(stream, edgeCount)) {
+			records.clear();
+			return false;
+		}
+		record.edges.resize(edgeCount);
+		for (auto& [index, observedVersion] : record.edges) {
+			if (!SnapshotFormat::read(stream, index) || !SnapshotFormat::read(stream, observedVersion) || index >= count) {
+				records.clear();
+				return false;
+			}
+		}
+	}
+
+	nodes.clear();
+	restoring = true;
+	return true;
+}
+
+inline bool GraphSnapshot::matches() {
+	if (nodes.size() != records.size())
+		return false;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		Node& node = nodes[i];
+		Record& record = records[i];
+		if (record.reaction != (node.reaction != nullptr))
+			return false;
+		if (node.property && (record.type != node.property->snapshotType() || record.computed != (node.property->reactionSide() != nullptr)))
+			return false;
+		for (auto& [index, observedVersion] : record.edges) {
+			if (!nodes[index].property)
+				return false;
+		}
+	}
+	return true;
+}
+
+inline void GraphSnapshot::finish() {
+	restoring = false;
+	wasRestored = matches();
+	if (wasRestored)
+		restore();
+	else
+		runEverything();
+	records.clear();
+	records.shrink_to_fit();
+}
+
+// The reactions were created but never ran; computed properties are lazy anyway and are
+// still dirty from being bound.
+inline void GraphSnapshot::runEverything() {
+	Reaction::DeferredGuard _;
+	for (Node& node : nodes) {
+		if (node.reaction)
+			static_cast<ReactionBase*>(node.reaction)->makeDirty(Freshness::Dirty);
+	}
+}
+
+inline void GraphSnapshot::restore() {
+	// Versions and heights first, so the edges rebuilt next see the right ones.
+	std::vector<PropertyBase*> changed;
+	std::vector<std::pair<ReactionBase*, const Record*>> linked;
+	std::vector<Reaction*> rerun;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		Node& node = nodes[i];
+		Record& record = records[i];
+		if (node.reaction) {
+			if (record.complete)
+				linked.emplace_back(node.reaction, &record);
+			else
+				rerun.push_back(node.reaction);
+			continue;
+		}
+
+		PropertyBase& property = *node.property;
+		property.height = record.height;
+		if (!record.computed) {
+			// Dependents saw the recorded version; a different value has to look newer.
+			property.version = record.version;
+			if (!record.hasValue || !property.decodeValue(record.value, true)) {
+				property.version++;
+				changed.push_back(&property);
+			}
+		}
+		else if (record.hasValue && property.decodeValue(record.value, false)) {
+			property.version = record.version;
+			linked.emplace_back(property.reactionSide(), &record);
+		}
+		else {
+			// Stays dirty and recomputes when read; whatever read it before has to read it again.
+			property.version = record.version + 1;
+			changed.push_back(&property);
+		}
+	}
+
+	for (auto& [reaction, record] : linked) {
+		reaction->beginTracking();
+		for (auto& [index, observedVersion] : record->edges) {
+			reaction->addTriggeringProperty(nodes[index].property);
+		}
+		reaction->endTracking();
+
+		Dependency* dependency = reaction->firstTrigger;
+		for (auto& [index, observedVersion] : record->edges) {
+			if (!dependency)
+				break;
+			dependency->observedVersion = observedVersion;
+			dependency = dependency->nextTrigger;
+		}
+	}
+
+	Reaction::DeferredGuard _;
+	for (PropertyBase* property : changed) {
+		property->makeDependentReactionsDirty(Freshness::Dirty);
+	}
+	for (Reaction* reaction : rerun) {
+		static_cast<ReactionBase*>(reaction)->makeDirty(Freshness::Dirty);
+	}
+}
+
+#define Declarative(type, name)\
+inline const type& name() { return Property##name.getValue(); }\
+inline void set##name(const type& value) { Property##name.setValue(value); }\
+inline void set##name(type&& value) { Property##name.setValue(std::move(value)); }\
+/*__declspec(property(get = get##name, put = set##name)) type name;*/\
+Property<type> Property##name\
+
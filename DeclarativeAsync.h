@@ -0,0 +1,319 @@
+#pragma once
+#include "Declarative.h"
+#include <coroutine>
+#include <optional>
+#include <vector>
+
+
+template<typename T>
+class AsyncProperty;
+
+enum class AsyncState : unsigned char {
+	Pending,
+	Ready,
+	Error,
+};
+
+// Thrown inside a computation at the co_await it resumes from once a newer one has replaced
+// it, so it unwinds without touching the graph.
+struct AsyncCancelled : std::exception {
+	const char* what() const noexcept override {
+		return "Async computation cancelled";
+	}
+};
+
+// Frames that an exception left through unhandled_exception(). Such a frame counts as
+// suspended at its final point, so final_suspend() never gets to destroy it; it is destroyed
+// here instead, on the next computation started on the thread or when the thread exits.
+class AsyncFrames {
+	std::vector<std::coroutine_handle<>> frames;
+
+	AsyncFrames() = default;
+
+public:
+	AsyncFrames(const AsyncFrames&) = delete;
+
+	~AsyncFrames() {
+		destroy();
+	}
+
+	static AsyncFrames& get() {
+		thread_local AsyncFrames threadFrames{};
+		return threadFrames;
+	}
+
+	void park(std::coroutine_handle<> frame) {
+		frames.push_back(frame);
+	}
+
+	void destroy() {
+		// Each frame is taken off first: destroying its locals may start another computation,
+		// which comes back here.
+		while (!frames.empty()) {
+			std::coroutine_handle<> frame = frames.back();
+			frames.pop_back();
+			frame.destroy();
+		}
+	}
+};
+
+// Return type of the coroutines bound to an AsyncProperty<T>. A computation reads properties
+// like any other binding, in every stretch between two co_awaits: each time it resumes, the
+// property it computes is set up as the current tracker again. Resume it on the thread the
+// graph belongs to.
+template<typename T>
+class AsyncTask {
+public:
+	struct promise_type {
+		AsyncProperty<T>* owner = nullptr;
+		ReactionBase* resumedFrom = nullptr;
+		bool tracking = false;
+
+		void enter();
+		void leave() {
+			if (tracking)
+				ReactiveContext::get().current = resumedFrom;
+			tracking = false;
+		}
+
+		AsyncTask get_return_object() {
+			return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept {
+			return {};
+		}
+
+		// The frame destroys itself once it is done, whether or not anyone still wants the result.
+		std::suspend_never final_suspend() noexcept {
+			return {};
+		}
+
+		// Results are published from here rather than from final_suspend(), which must not
+		// throw, while publishing flushes the readers, which may.
+		template<typename U>
+		void return_value(U&& result) {
+			leave();
+			if (AsyncProperty<T>* property = std::exchange(owner, nullptr))
+				property->succeed(std::forward<U>(result));
+		}
+
+		// A flush started by publishing that throws comes through here too, after owner was
+		// cleared, and is passed on to whoever resumed the computation. The frame is left
+		// behind for AsyncFrames then.
+		void unhandled_exception() {
+			leave();
+			AsyncProperty<T>* property = std::exchange(owner, nullptr);
+			if (!property) {
+				try {
+					throw;
+				}
+				catch (const AsyncCancelled&) {
+					return;
+				}
+				catch (...) {
+					AsyncFrames::get().park(std::coroutine_handle<promise_type>::from_promise(*this));
+					throw;
+				}
+			}
+			try {
+				property->fail(std::current_exception());
+			}
+			catch (...) {
+				AsyncFrames::get().park(std::coroutine_handle<promise_type>::from_promise(*this));
+				throw;
+			}
+		}
+
+		template<typename Awaiter>
+		struct TrackingAwaiter {
+			Awaiter awaiter;
+			std::coroutine_handle<promise_type> handle;
+
+			bool await_ready() {
+				return awaiter.await_ready();
+			}
+
+			template<typename Handle>
+			decltype(auto) await_suspend(Handle handle) {
+				handle.promise().leave();
+				return awaiter.await_suspend(handle);
+			}
+
+			decltype(auto) await_resume() {
+				promise_type& promise = handle.promise();
+				if (!promise.owner)
+					throw AsyncCancelled();
+				promise.enter();
+				return awaiter.await_resume();
+			}
+		};
+
+		template<typename Awaitable>
+		auto await_transform(Awaitable&& awaitable) {
+			using Awaiter = decltype(awaiterOf(std::forward<Awaitable>(awaitable)));
+			return TrackingAwaiter<Awaiter>{ awaiterOf(std::forward<Awaitable>(awaitable)), std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+
+	private:
+		template<typename Awaitable>
+		static decltype(auto) awaiterOf(Awaitable&& awaitable) {
+			if constexpr (requires { std::forward<Awaitable>(awaitable).operator co_await(); })
+				return std::forward<Awaitable>(awaitable).operator co_await();
+			else if constexpr (requires { operator co_await(std::forward<Awaitable>(awaitable)); })
+				return operator co_await(std::forward<Awaitable>(awaitable));
+			else
+				return std::forward<Awaitable>(awaitable);
+		}
+	};
+
+private:
+	std::coroutine_handle<promise_type> handle;
+
+	AsyncTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	template<typename> friend class AsyncProperty;
+
+public:
+	AsyncTask(AsyncTask&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+	AsyncTask(const AsyncTask&) = delete;
+
+	// Only a computation that was never started is still owned here.
+	~AsyncTask() {
+		if (handle)
+			handle.destroy();
+	}
+};
+
+// Property whose function is a coroutine, e.g. one that fetches from disk or over RPC, so
+// the flush never waits for it. Whenever a source changes it starts over, and the computation
+// still in flight is cancelled at its next co_await. Until the new one finishes, the property
+// is Pending and keeps the last value it had.
+template<typename T>
+class AsyncProperty : PropertyBase, ReactionBase {
+	friend typename AsyncTask<T>::promise_type;
+	friend class GraphInspector;
+public:
+	using Function = InplaceFunction<AsyncTask<T>()>;
+
+private:
+	T value = {};
+	AsyncState state = AsyncState::Pending;
+	std::exception_ptr error;
+	Function function;
+	typename AsyncTask<T>::promise_type* running = nullptr;
+	// Restarts are run by the flush rather than from makeDirty(), so a computation is never
+	// replaced in the middle of one of its own stretches.
+	Reaction restarter = GraphSnapshot::excluded([this] { return Reaction([this]() { restart(); }); });
+
+	void restart() {
+		if (freshness == Freshness::Check && !sourcesChanged()) {
+			freshness = Freshness::Clean;
+			return;
+		}
+		start();
+	}
+
+	void start() {
+		ReactiveContext& context = ReactiveContext::get();
+		AsyncFrames::get().destroy();
+		if (running)
+			running->owner = nullptr;
+		running = nullptr;
+
+		beginTracking();
+		if (state != AsyncState::Pending) {
+			state = AsyncState::Pending;
+			valueChanged(context);
+		}
+
+		AsyncTask<T> task = function();
+		auto handle = std::exchange(task.handle, {});
+		typename AsyncTask<T>::promise_type& promise = handle.promise();
+		promise.owner = this;
+		running = &promise;
+		promise.enter();
+		handle.resume();
+	}
+
+	void finish() {
+		running = nullptr;
+		endTracking();
+		height = rank;
+	}
+
+	template<typename U>
+	void succeed(U&& result) {
+		finish();
+		value = std::forward<U>(result);
+		error = nullptr;
+		state = AsyncState::Ready;
+		valueChanged(ReactiveContext::get());
+	}
+
+	void fail(std::exception_ptr error) {
+		finish();
+		this->error = error;
+		state = AsyncState::Error;
+		valueChanged(ReactiveContext::get());
+	}
+
+	virtual PropertyBase* makeDirty(Freshness freshness) override {
+		if (freshness > this->freshness)
+			this->freshness = freshness;
+		static_cast<ReactionBase&>(restarter).makeDirty(Freshness::Dirty);
+		return nullptr;
+	}
+
+	virtual ReactionBase* reactionSide() override {
+		return this;
+	}
+
+	virtual PropertyBase* propertySide() override {
+		return this;
+	}
+
+public:
+	template<typename TLambda, class enable = std::enable_if_t<std::is_same_v<AsyncTask<T>, std::invoke_result_t<TLambda&>>>>
+	AsyncProperty(TLambda lambda) : function(std::move(lambda)) {}
+
+	AsyncProperty(const AsyncProperty&) = delete;
+
+	~AsyncProperty() {
+		if (running)
+			running->owner = nullptr;
+	}
+
+	using PropertyBase::setName;
+	using PropertyBase::getName;
+
+	// The last value computed successfully; default constructed until there is one.
+	const T& getValue() {
+		track(ReactiveContext::get());
+		return value;
+	}
+
+	AsyncState getState() {
+		track(ReactiveContext::get());
+		return state;
+	}
+
+	// What the last computation threw, while the state is Error.
+	std::exception_ptr getError() {
+		track(ReactiveContext::get());
+		return error;
+	}
+
+	operator const T& () {
+		return getValue();
+	}
+};
+
+template<typename T>
+inline void AsyncTask<T>::promise_type::enter() {
+	ReactiveContext& context = ReactiveContext::get();
+	resumedFrom = context.current;
+	context.current = owner;
+	tracking = true;
+}
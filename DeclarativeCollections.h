@@ -0,0 +1,1114 @@
+#pragma once
+#include "Declarative.h"
+#include <unordered_map>
+#include <functional>
+#include <optional>
+#include <span>
+#include <bit>
+#include <cstdint>
+
+
+// Changes made to a collection, numbered consecutively. A reader remembers the sequence it
+// has caught up to and asks for what came after it. Only the recent past is kept: once a
+// reader falls further behind than the collection is large, it is cheaper for it to start
+// over from the current contents.
+template<typename Change>
+class ChangeLog {
+	std::deque<Change> changes;
+	unsigned long long firstSequence = 0;
+
+public:
+	unsigned long long sequence() const {
+		return firstSequence + changes.size();
+	}
+
+	void append(Change change, size_t retain) {
+		changes.push_back(std::move(change));
+		while (changes.size() > retain) {
+			changes.pop_front();
+			firstSequence++;
+		}
+	}
+
+	// Returns false without calling function if the changes after sequence were dropped already.
+	template<typename Function>
+	bool since(unsigned long long sequence, Function&& function) const {
+		if (sequence < firstSequence)
+			return false;
+		for (size_t i = sequence - firstSequence; i < changes.size(); i++) {
+			function(changes[i]);
+		}
+		return true;
+	}
+};
+
+// Node for one element of a collection, created the first time a reaction reads just that
+// element and handed back to the collection as soon as nothing depends on it any more.
+template<typename Owner, typename Key>
+class ElementNode : public PropertyBase {
+	Owner& owner;
+	Key key;
+
+	virtual void unobserved() override {
+		// Releasing the element destroys this node, key included.
+		Key released = key;
+		owner.releaseElement(released);
+	}
+
+public:
+	ElementNode(Owner& owner, Key key) : owner(owner), key(std::move(key)) {}
+
+	void track(ReactiveContext& context) {
+		PropertyBase::track(context);
+	}
+
+	void changed(ReactiveContext& context) {
+		valueChanged(context);
+	}
+};
+
+
+// Reactive sequence. Reading it as a whole (size, indexing, iteration) subscribes to every
+// change; find() subscribes to one element only. Every element gets an id that never changes
+// and is never reused, and every change is logged, so dependents can catch up incrementally
+// with changesSince() instead of rescanning the list.
+template<typename T>
+class PropertyList : PropertyBase {
+public:
+	using Id = unsigned long long;
+
+	struct Entry {
+		Id id;
+		T value;
+	};
+
+	// index is the position at the time of the change. Reset means the contents were replaced
+	// wholesale. Changes carry no values: readers look them up in the current contents.
+	struct Change {
+		enum class Kind : unsigned char {
+			Insert,
+			Remove,
+			Update,
+			Reset,
+		};
+
+		Kind kind;
+		size_t index;
+		Id id;
+	};
+
+	static constexpr size_t npos = ~size_t(0);
+
+private:
+	using Node = ElementNode<PropertyList, Id>;
+	friend Node;
+	template<typename> friend class CollectionView;
+
+	std::vector<Entry> entries;
+	// Positions are only exact for the first validPositions entries. Every other entry is at
+	// most shifts places away from the position recorded for it, since each insert or erase
+	// moves it by one at most.
+	std::unordered_map<Id, size_t> positions;
+	size_t validPositions = 0;
+	size_t shifts = 0;
+	std::unordered_map<Id, std::unique_ptr<Node>> nodes;
+	ChangeLog<Change> log;
+	Id lastId = 0;
+
+	size_t position(Id id) {
+		auto found = positions.find(id);
+		if (found == positions.end())
+			return npos;
+		size_t recorded = found->second;
+		if (recorded < validPositions)
+			return recorded;
+
+		// Searching around the recorded position is cheaper than renumbering the tail until
+		// the entries have drifted by more than about the square root of the size.
+		if (shifts <= 64 || shifts * shifts <= entries.size()) {
+			for (size_t distance = 0; distance <= shifts; distance++) {
+				if (recorded + distance < entries.size() && entries[recorded + distance].id == id)
+					return found->second = recorded + distance;
+				if (distance <= recorded && recorded - distance < entries.size() && entries[recorded - distance].id == id)
+					return found->second = recorded - distance;
+			}
+		}
+
+		for (size_t i = validPositions; i < entries.size(); i++) {
+			positions[entries[i].id] = i;
+		}
+		validPositions = entries.size();
+		shifts = 0;
+		return positions[id];
+	}
+
+	void shifted(size_t index) {
+		if (index < validPositions)
+			validPositions = index;
+		if (index < entries.size())
+			shifts++;
+	}
+
+	Node& element(Id id) {
+		std::unique_ptr<Node>& node = nodes[id];
+		if (!node)
+			node = std::make_unique<Node>(*this, id);
+		return *node;
+	}
+
+	void releaseElement(Id id) {
+		nodes.erase(id);
+	}
+
+	void record(ReactiveContext& context, Change change) {
+		Reaction::DeferredGuard _(context);
+		if (change.kind == Change::Kind::Reset) {
+			for (auto& [id, node] : nodes) {
+				node->changed(context);
+			}
+		}
+		else if (auto found = nodes.find(change.id); found != nodes.end()) {
+			found->second->changed(context);
+		}
+		log.append(std::move(change), 2 * entries.size() + 64);
+		valueChanged(context);
+	}
+
+	Id insertAt(size_t index, T value) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		Id id = ++lastId;
+		entries.insert(entries.begin() + index, Entry{ id, std::move(value) });
+		positions[id] = index;
+		if (index == validPositions && index + 1 == entries.size())
+			validPositions++;
+		else
+			shifted(index);
+		record(context, { Change::Kind::Insert, index, id });
+		return id;
+	}
+
+public:
+	PropertyList() = default;
+
+	PropertyList(const PropertyList&) = delete;
+
+	PropertyList(std::initializer_list<T> values) {
+		for (auto& value : values) {
+			pushBack(value);
+		}
+	}
+
+	using PropertyBase::setName;
+	using PropertyBase::getName;
+
+	size_t size() {
+		track(ReactiveContext::get());
+		return entries.size();
+	}
+
+	bool empty() {
+		return size() == 0;
+	}
+
+	const T& operator[](size_t index) {
+		track(ReactiveContext::get());
+		return entries[index].value;
+	}
+
+	Id idAt(size_t index) {
+		track(ReactiveContext::get());
+		return entries[index].id;
+	}
+
+	// Subscribes to the whole list, since the position moves with every insert before it.
+	size_t indexOf(Id id) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		track(context);
+		return position(id);
+	}
+
+	typename std::vector<Entry>::const_iterator begin() {
+		track(ReactiveContext::get());
+		return entries.cbegin();
+	}
+
+	typename std::vector<Entry>::const_iterator end() {
+		return entries.cend();
+	}
+
+	// Only re-runs the reader when this element changes or is removed. Null once it is gone.
+	const T* find(Id id) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		size_t index = position(id);
+		if (index == npos)
+			return nullptr;
+		if (context.current)
+			element(id).track(context);
+		return &entries[index].value;
+	}
+
+	// The sequence to pass to changesSince() next time to see only what happens after now.
+	unsigned long long changeSequence() {
+		track(ReactiveContext::get());
+		return log.sequence();
+	}
+
+	// Calls function for each change made after sequence, oldest first. Returns false, calling
+	// nothing, when those are no longer all logged; the reader has to start over then.
+	template<typename Function>
+	bool changesSince(unsigned long long sequence, Function&& function) {
+		track(ReactiveContext::get());
+		return log.since(sequence, std::forward<Function>(function));
+	}
+
+	Id pushBack(T value) {
+		return insertAt(entries.size(), std::move(value));
+	}
+
+	Id insert(size_t index, T value) {
+		return insertAt(index, std::move(value));
+	}
+
+	void erase(size_t index) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		Id id = entries[index].id;
+		entries.erase(entries.begin() + index);
+		positions.erase(id);
+		shifted(index);
+		record(context, { Change::Kind::Remove, index, id });
+	}
+
+	void set(size_t index, T value) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		if constexpr (std::equality_comparable<T>) {
+			if (entries[index].value == value)
+				return;
+		}
+		entries[index].value = std::move(value);
+		record(context, { Change::Kind::Update, index, entries[index].id });
+	}
+
+	void clear() {
+		assign({});
+	}
+
+	void assign(std::vector<T> values) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		entries.clear();
+		positions.clear();
+		for (auto& value : values) {
+			Id id = ++lastId;
+			positions[id] = entries.size();
+			entries.push_back(Entry{ id, std::move(value) });
+		}
+		validPositions = entries.size();
+		shifts = 0;
+		record(context, { Change::Kind::Reset, 0, 0 });
+	}
+};
+
+// Reactive hash map. Reading it as a whole (size, iteration) subscribes to every change;
+// find() and contains() subscribe to one key only, whether or not it is present yet.
+// Changes are logged as for PropertyList.
+template<typename K, typename V, typename Hash = std::hash<K>>
+class PropertyMap : PropertyBase {
+public:
+	// Reset means the contents were replaced wholesale.
+	struct Change {
+		enum class Kind : unsigned char {
+			Insert,
+			Remove,
+			Update,
+			Reset,
+		};
+
+		Kind kind;
+		K key;
+	};
+
+private:
+	using Node = ElementNode<PropertyMap, K>;
+	friend Node;
+	template<typename> friend class CollectionView;
+
+	std::unordered_map<K, V, Hash> values;
+	std::unordered_map<K, std::unique_ptr<Node>, Hash> nodes;
+	ChangeLog<Change> log;
+
+	void releaseElement(const K& key) {
+		nodes.erase(key);
+	}
+
+	void record(ReactiveContext& context, Change change) {
+		Reaction::DeferredGuard _(context);
+		if (change.kind == Change::Kind::Reset) {
+			for (auto& [key, node] : nodes) {
+				node->changed(context);
+			}
+		}
+		else if (auto found = nodes.find(change.key); found != nodes.end()) {
+			found->second->changed(context);
+		}
+		log.append(std::move(change), 2 * values.size() + 64);
+		valueChanged(context);
+	}
+
+	void trackKey(ReactiveContext& context, const K& key) {
+		if (!context.current)
+			return;
+		std::unique_ptr<Node>& node = nodes[key];
+		if (!node)
+			node = std::make_unique<Node>(*this, key);
+		node->track(context);
+	}
+
+public:
+	PropertyMap() = default;
+
+	PropertyMap(const PropertyMap&) = delete;
+
+	using PropertyBase::setName;
+	using PropertyBase::getName;
+
+	size_t size() {
+		track(ReactiveContext::get());
+		return values.size();
+	}
+
+	bool empty() {
+		return size() == 0;
+	}
+
+	typename std::unordered_map<K, V, Hash>::const_iterator begin() {
+		track(ReactiveContext::get());
+		return values.cbegin();
+	}
+
+	typename std::unordered_map<K, V, Hash>::const_iterator end() {
+		return values.cend();
+	}
+
+	const V* find(const K& key) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		trackKey(context, key);
+		auto found = values.find(key);
+		return found != values.end() ? &found->second : nullptr;
+	}
+
+	bool contains(const K& key) {
+		return find(key) != nullptr;
+	}
+
+	unsigned long long changeSequence() {
+		track(ReactiveContext::get());
+		return log.sequence();
+	}
+
+	template<typename Function>
+	bool changesSince(unsigned long long sequence, Function&& function) {
+		track(ReactiveContext::get());
+		return log.since(sequence, std::forward<Function>(function));
+	}
+
+	void set(const K& key, V value) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		auto [found, inserted] = values.try_emplace(key, std::move(value));
+		if (!inserted) {
+			if constexpr (std::equality_comparable<V>) {
+				if (found->second == value)
+					return;
+			}
+			found->second = std::move(value);
+		}
+		record(context, { inserted ? Change::Kind::Insert : Change::Kind::Update, key });
+	}
+
+	bool erase(const K& key) {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		if (!values.erase(key))
+			return false;
+		record(context, { Change::Kind::Remove, key });
+		return true;
+	}
+
+	void clear() {
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+		values.clear();
+		record(context, { Change::Kind::Reset, K{} });
+	}
+};
+
+
+// Fixed number of values of one type, stored as plain arrays instead of one node each: the
+// values, the version each last changed at, and a bit per element that stays set until the
+// next scanDirty(). Reading all() subscribes to the whole array; get() to one element,
+// through a node that only exists while someone reads that element. Bulk writes compare and
+// store a block of 64 elements at a time and only look for element nodes where some exist.
+template<typename T>
+class PropertyArray : PropertyBase {
+	using Node = ElementNode<PropertyArray, size_t>;
+	friend Node;
+
+	static constexpr size_t wordBits = 64;
+
+	std::vector<T> values;
+	std::vector<unsigned long long> versions;
+	std::vector<std::uint64_t> dirty;
+	// Elements that have a node.
+	std::vector<std::uint64_t> observed;
+	std::unordered_map<size_t, std::unique_ptr<Node>> nodes;
+
+	void releaseElement(size_t index) {
+		observed[index / wordBits] &= ~(std::uint64_t(1) << index % wordBits);
+		nodes.erase(index);
+	}
+
+	static bool same(const T& a, const T& b) {
+		if constexpr (std::equality_comparable<T>)
+			return a == b;
+		else
+			return false;
+	}
+
+	// Stores incoming over the elements from first on that lie in word, returning a mask of
+	// the ones that changed.
+	std::uint64_t storeWord(size_t word, size_t first, std::span<const T> incoming) {
+		size_t begin = std::max(word * wordBits, first);
+		size_t end = std::min(word * wordBits + wordBits, first + incoming.size());
+		T* target = values.data();
+		const T* source = incoming.data() - first;
+
+		if (end - begin == wordBits) {
+			// Full words, i.e. all but the ends of a long write, go through loops of fixed
+			// length that vectorize. Most words of a sparse update stay as they are.
+			T* block = target + begin;
+			const T* from = source + begin;
+			bool differs[wordBits];
+			bool any = false;
+			for (size_t i = 0; i < wordBits; i++) {
+				differs[i] = !same(block[i], from[i]);
+				any |= differs[i];
+			}
+			if (!any)
+				return 0;
+
+			std::uint64_t changed = 0;
+			for (size_t i = 0; i < wordBits; i++) {
+				changed |= std::uint64_t(differs[i]) << i;
+			}
+			if constexpr (std::is_trivially_copyable_v<T>) {
+				std::memcpy(block, from, sizeof(T) * wordBits);
+			}
+			else {
+				for (size_t i = 0; i < wordBits; i++) {
+					if (differs[i])
+						block[i] = from[i];
+				}
+			}
+			return changed;
+		}
+
+		std::uint64_t changed = 0;
+		for (size_t i = begin; i < end; i++) {
+			bool differs = !same(target[i], source[i]);
+			changed |= std::uint64_t(differs) << (i - word * wordBits);
+			if (differs)
+				target[i] = source[i];
+		}
+		return changed;
+	}
+
+	// Marks and stamps the changed elements of words first to last and tells their nodes.
+	// Returns whether anything changed.
+	bool publish(ReactiveContext& context, size_t firstWord, size_t lastWord, const std::uint64_t* changed, unsigned long long stamp) {
+		bool any = false;
+		for (size_t word = firstWord; word <= lastWord; word++) {
+			std::uint64_t mask = changed[word - firstWord];
+			if (!mask)
+				continue;
+			any = true;
+			dirty[word] |= mask;
+			if (mask == ~std::uint64_t(0)) {
+				std::fill_n(versions.begin() + word * wordBits, wordBits, stamp);
+			}
+			else {
+				for (std::uint64_t bits = mask; bits; bits &= bits - 1) {
+					versions[word * wordBits + std::countr_zero(bits)] = stamp;
+				}
+			}
+			for (std::uint64_t reached = mask & observed[word]; reached; reached &= reached - 1) {
+				nodes.find(word * wordBits + std::countr_zero(reached))->second->changed(context);
+			}
+		}
+		return any;
+	}
+
+public:
+	PropertyArray(size_t count, const T& initial = {}) : values(count, initial), versions(count, 0),
+		dirty((count + wordBits - 1) / wordBits, 0), observed((count + wordBits - 1) / wordBits, 0) {}
+
+	PropertyArray(const PropertyArray&) = delete;
+
+	using PropertyBase::setName;
+	using PropertyBase::getName;
+
+	size_t size() const {
+		return values.size();
+	}
+
+	std::span<const T> all() {
+		track(ReactiveContext::get());
+		return values;
+	}
+
+	// Only re-runs the reader when this element changes.
+	const T& get(size_t index) {
+		ReactiveContext& context = ReactiveContext::get();
+		if (context.current) {
+			GraphLock lock(context);
+			std::unique_ptr<Node>& node = nodes[index];
+			if (!node) {
+				node = std::make_unique<Node>(*this, index);
+				observed[index / wordBits] |= std::uint64_t(1) << index % wordBits;
+			}
+			node->track(context);
+		}
+		return values[index];
+	}
+
+	const T& operator[](size_t index) {
+		return get(index);
+	}
+
+	// The version of the array as of the last change to this element; compare against
+	// lastVersion() from an earlier point to tell whether it changed since.
+	unsigned long long versionOf(size_t index) const {
+		return versions[index];
+	}
+
+	unsigned long long lastVersion() const {
+		return version;
+	}
+
+	void set(size_t index, T value) {
+		setValues(index, std::span<const T>(&value, 1));
+	}
+
+	// Overwrites the elements from first on with incoming, as one change to the array.
+	void setValues(size_t first, std::span<const T> incoming) {
+		if (incoming.empty())
+			return;
+		ReactiveContext& context = ReactiveContext::get();
+		GraphLock lock(context);
+
+		size_t firstWord = first / wordBits;
+		size_t lastWord = (first + incoming.size() - 1) / wordBits;
+		// Masks are gathered in chunks so a long write needs no buffer proportional to it.
+		constexpr size_t chunk = 64;
+		std::uint64_t changed[chunk];
+		Reaction::DeferredGuard _(context);
+		bool any = false;
+		for (size_t word = firstWord; word <= lastWord; word += chunk) {
+			size_t last = std::min(lastWord, word + chunk - 1);
+			for (size_t w = word; w <= last; w++) {
+				changed[w - word] = storeWord(w, first, incoming);
+			}
+			any |= publish(context, word, last, changed, version + 1);
+		}
+		if (any)
+			valueChanged(context);
+	}
+
+	void setValues(std::span<const T> incoming) {
+		setValues(0, incoming);
+	}
+
+	// Calls function(index, value) for every element changed since the previous scan, in index
+	// order, and clears their marks; returns how many there were. Meant for the one consumer
+	// that mirrors the array elsewhere, e.g. uploading changed values to the GPU. Subscribes to
+	// the whole array.
+	template<typename Function>
+	size_t scanDirty(Function&& function) {
+		track(ReactiveContext::get());
+		size_t count = 0;
+		for (size_t word = 0; word < dirty.size(); word++) {
+			for (std::uint64_t bits = std::exchange(dirty[word], 0); bits; bits &= bits - 1) {
+				size_t index = word * wordBits + std::countr_zero(bits);
+				function(index, static_cast<const T&>(values[index]));
+				count++;
+			}
+		}
+		return count;
+	}
+};
+
+
+// Base of the views derived from a PropertyList. Their outputs are kept up to date by a
+// reaction that replays the source's change log, and only fall back to rebuilding from the
+// whole source on a Reset or when the log no longer reaches back far enough. Outputs are for
+// reading: anything written to them directly is lost on the next rebuild.
+template<typename T>
+class CollectionView {
+protected:
+	using Id = typename PropertyList<T>::Id;
+	using Change = typename PropertyList<T>::Change;
+
+	PropertyList<T>& source;
+
+	CollectionView(PropertyList<T>& source) : source(source) {}
+
+	CollectionView(const CollectionView&) = delete;
+
+	virtual ~CollectionView() = default;
+
+	// Applies one change to the outputs. Returning false abandons the rest for a rebuild.
+	virtual bool apply(const Change& change) = 0;
+	virtual void rebuild() = 0;
+
+	// Called at the end of the derived constructor, once apply() and rebuild() may run.
+	void start() {
+		GraphSnapshot::excluded([this] { maintainer.emplace([this]() { maintain(); }); });
+	}
+
+	// Makes readers of an output rank after the reaction writing it, as they would behind a
+	// computed property.
+	template<typename Output>
+	void follow(Output& output) {
+		output.height = source.height + 1;
+	}
+
+	// Values are looked up without subscribing: the view already depends on the whole source.
+	const T* lookup(Id id) {
+		return untracked([&] { return source.find(id); });
+	}
+
+	// Where the element is in the source now, or npos once it is gone. Elements never move
+	// relative to each other, so this orders the outputs by source even while changes are
+	// still to be replayed.
+	size_t sourcePosition(Id id) {
+		GraphLock lock(ReactiveContext::get());
+		return source.position(id);
+	}
+
+private:
+	unsigned long long sequence = 0;
+	bool built = false;
+	std::optional<Reaction> maintainer;
+
+	void maintain() {
+		unsigned long long latest = source.changeSequence();
+		untracked([&] {
+			bool consistent = built;
+			bool logged = consistent && source.changesSince(sequence, [&](const Change& change) {
+				if (!consistent)
+					return;
+				consistent = change.kind != Change::Kind::Reset && apply(change);
+			});
+			if (!logged || !consistent) {
+				rebuild();
+				built = true;
+			}
+		});
+		sequence = latest;
+	}
+};
+
+// The elements of the source that satisfy predicate, in source order. Updates of elements
+// already shown are O(1); placing a newly passing element costs a scan back to the nearest
+// shown one before it.
+template<typename T, typename Predicate>
+class FilteredList : CollectionView<T> {
+	using typename CollectionView<T>::Id;
+	using typename CollectionView<T>::Change;
+
+	Predicate predicate;
+	PropertyList<T> output;
+	// Source ids in source order, and the output id of each one that passes.
+	std::vector<Id> order;
+	std::unordered_map<Id, Id> shown;
+
+	void show(size_t index, Id id, const T& value) {
+		size_t position = 0;
+		for (size_t i = index; i-- > 0;) {
+			if (auto found = shown.find(order[i]); found != shown.end()) {
+				position = output.indexOf(found->second) + 1;
+				break;
+			}
+		}
+		shown[id] = output.insert(position, value);
+	}
+
+	void hide(Id id) {
+		if (auto found = shown.find(id); found != shown.end()) {
+			output.erase(output.indexOf(found->second));
+			shown.erase(found);
+		}
+	}
+
+	virtual bool apply(const Change& change) override {
+		if (change.kind == Change::Kind::Insert) {
+			order.insert(order.begin() + change.index, change.id);
+			const T* value = this->lookup(change.id);
+			if (value && predicate(*value))
+				show(change.index, change.id, *value);
+		}
+		else if (change.kind == Change::Kind::Remove) {
+			order.erase(order.begin() + change.index);
+			hide(change.id);
+		}
+		else if (const T* value = this->lookup(change.id)) {
+			auto found = shown.find(change.id);
+			if (!predicate(*value))
+				hide(change.id);
+			else if (found != shown.end())
+				output.set(output.indexOf(found->second), *value);
+			else
+				show(change.index, change.id, *value);
+		}
+		return true;
+	}
+
+	virtual void rebuild() override {
+		this->follow(output);
+		order.clear();
+		shown.clear();
+		std::vector<T> values;
+		std::vector<Id> passing;
+		for (auto& entry : this->source) {
+			order.push_back(entry.id);
+			if (predicate(entry.value)) {
+				values.push_back(entry.value);
+				passing.push_back(entry.id);
+			}
+		}
+		output.assign(std::move(values));
+		for (size_t i = 0; i < passing.size(); i++) {
+			shown[passing[i]] = output.idAt(i);
+		}
+	}
+
+public:
+	FilteredList(PropertyList<T>& source, Predicate predicate) : CollectionView<T>(source), predicate(std::move(predicate)) {
+		this->start();
+	}
+
+	PropertyList<T>& list() {
+		return output;
+	}
+};
+
+// function applied to every element of the source, position for position.
+template<typename T, typename Function>
+class MappedList : CollectionView<T> {
+	using typename CollectionView<T>::Id;
+	using typename CollectionView<T>::Change;
+	using U = std::decay_t<std::invoke_result_t<Function&, const T&>>;
+
+	Function function;
+	PropertyList<U> output;
+
+	virtual bool apply(const Change& change) override {
+		if (change.kind == Change::Kind::Remove) {
+			output.erase(change.index);
+			return true;
+		}
+
+		const T* value = this->lookup(change.id);
+		if (change.kind == Change::Kind::Insert) {
+			// Inserted and removed again since: the positions after it only line up on a rebuild.
+			if (!value)
+				return false;
+			output.insert(change.index, function(*value));
+		}
+		else if (value) {
+			output.set(change.index, function(*value));
+		}
+		return true;
+	}
+
+	virtual void rebuild() override {
+		this->follow(output);
+		std::vector<U> values;
+		for (auto& entry : this->source) {
+			values.push_back(function(entry.value));
+		}
+		output.assign(std::move(values));
+	}
+
+public:
+	MappedList(PropertyList<T>& source, Function function) : CollectionView<T>(source), function(std::move(function)) {
+		this->start();
+	}
+
+	PropertyList<U>& list() {
+		return output;
+	}
+};
+
+// The elements of the source ordered by key; equal keys keep their source order. Each insert
+// or update is a binary search plus the shift of the output list.
+template<typename T, typename KeyFunction>
+class SortedList : CollectionView<T> {
+	using typename CollectionView<T>::Id;
+	using typename CollectionView<T>::Change;
+
+	KeyFunction key;
+	PropertyList<T> output;
+	std::unordered_map<Id, Id> placed;
+	// The source id of each output element.
+	std::unordered_map<Id, Id> origins;
+
+	// Negative if the output element at index belongs before an element with this key and
+	// source position, positive if after, and zero if it has left the source and only waits
+	// for its Remove to be replayed.
+	template<typename SortKey>
+	int compare(size_t index, const SortKey& sortKey, size_t position) {
+		auto other = key(output[index]);
+		if (sortKey < other)
+			return 1;
+		if (other < sortKey)
+			return -1;
+		size_t otherPosition = this->sourcePosition(origins[output.idAt(index)]);
+		if (otherPosition == PropertyList<T>::npos)
+			return 0;
+		return otherPosition < position ? -1 : 1;
+	}
+
+	void place(Id id, const T& value) {
+		auto sortKey = key(value);
+		size_t position = this->sourcePosition(id);
+		size_t low = 0;
+		size_t high = output.size();
+		while (low < high) {
+			size_t middle = (low + high) / 2;
+			int order = compare(middle, sortKey, position);
+			if (order > 0)
+				high = middle;
+			else if (order < 0)
+				low = middle + 1;
+			else {
+				// Left the source and only waits for its Remove to be replayed: drop it now so
+				// it cannot break the search.
+				unplace(origins[output.idAt(middle)]);
+				high--;
+			}
+		}
+		Id outputId = output.insert(low, value);
+		placed[id] = outputId;
+		origins[outputId] = id;
+	}
+
+	void unplace(Id id) {
+		if (auto found = placed.find(id); found != placed.end()) {
+			output.erase(output.indexOf(found->second));
+			origins.erase(found->second);
+			placed.erase(found);
+		}
+	}
+
+	virtual bool apply(const Change& change) override {
+		if (change.kind == Change::Kind::Remove) {
+			unplace(change.id);
+			return true;
+		}
+
+		const T* value = this->lookup(change.id);
+		if (!value)
+			return true;
+		if (change.kind == Change::Kind::Update) {
+			auto found = placed.find(change.id);
+			if (found != placed.end()) {
+				size_t index = output.indexOf(found->second);
+				auto sortKey = key(*value);
+				size_t position = this->sourcePosition(change.id);
+				// Still in order where it is: update in place.
+				if ((index == 0 || compare(index - 1, sortKey, position) < 0) && (index + 1 == output.size() || compare(index + 1, sortKey, position) > 0)) {
+					output.set(index, *value);
+					return true;
+				}
+			}
+			unplace(change.id);
+		}
+		place(change.id, *value);
+		return true;
+	}
+
+	virtual void rebuild() override {
+		this->follow(output);
+		std::vector<const typename PropertyList<T>::Entry*> entries;
+		for (auto& entry : this->source) {
+			entries.push_back(&entry);
+		}
+		std::stable_sort(entries.begin(), entries.end(), [this](auto a, auto b) { return key(a->value) < key(b->value); });
+
+		std::vector<T> values;
+		for (auto entry : entries) {
+			values.push_back(entry->value);
+		}
+		output.assign(std::move(values));
+		placed.clear();
+		origins.clear();
+		for (size_t i = 0; i < entries.size(); i++) {
+			placed[entries[i]->id] = output.idAt(i);
+			origins[output.idAt(i)] = entries[i]->id;
+		}
+	}
+
+public:
+	SortedList(PropertyList<T>& source, KeyFunction key) : CollectionView<T>(source), key(std::move(key)) {
+		this->start();
+	}
+
+	PropertyList<T>& list() {
+		return output;
+	}
+};
+
+// The elements of the source split by key into one list per group, each in source order.
+// keys() maps every non-empty group to its size. A group's list lives as long as the view, so
+// a reader may hold on to it while it is empty.
+template<typename T, typename KeyFunction>
+class GroupedList : CollectionView<T> {
+	using typename CollectionView<T>::Id;
+	using typename CollectionView<T>::Change;
+	using Key = std::decay_t<std::invoke_result_t<KeyFunction&, const T&>>;
+
+	struct Group {
+		PropertyList<T> list;
+		// The source id of each element of list.
+		std::unordered_map<Id, Id> origins;
+	};
+
+	KeyFunction key;
+	PropertyMap<Key, size_t> sizes;
+	std::unordered_map<Key, std::unique_ptr<Group>> groups;
+	// The group of each source element and its id in the group's list.
+	std::unordered_map<Id, std::pair<Key, Id>> placed;
+
+	Group& groupFor(const Key& groupKey) {
+		std::unique_ptr<Group>& group = groups[groupKey];
+		if (!group) {
+			group = std::make_unique<Group>();
+			this->follow(group->list);
+		}
+		return *group;
+	}
+
+	void add(Id id, const T& value) {
+		Key groupKey = key(value);
+		Group& group = groupFor(groupKey);
+		size_t position = this->sourcePosition(id);
+		size_t low = 0;
+		size_t high = group.list.size();
+		while (low < high) {
+			size_t middle = (low + high) / 2;
+			size_t other = this->sourcePosition(group.origins[group.list.idAt(middle)]);
+			if (other == PropertyList<T>::npos) {
+				// Left the source and only waits for its Remove to be replayed: drop it now so
+				// it cannot break the search.
+				remove(group.origins[group.list.idAt(middle)]);
+				high--;
+			}
+			else if (position < other)
+				high = middle;
+			else
+				low = middle + 1;
+		}
+		Id groupId = group.list.insert(low, value);
+		group.origins[groupId] = id;
+		placed.insert_or_assign(id, std::pair<Key, Id>{ groupKey, groupId });
+		sizes.set(groupKey, group.list.size());
+	}
+
+	void remove(Id id) {
+		auto found = placed.find(id);
+		if (found == placed.end())
+			return;
+		auto& [groupKey, groupId] = found->second;
+		Group& group = *groups[groupKey];
+		group.list.erase(group.list.indexOf(groupId));
+		group.origins.erase(groupId);
+		if (group.list.empty())
+			sizes.erase(groupKey);
+		else
+			sizes.set(groupKey, group.list.size());
+		placed.erase(found);
+	}
+
+	virtual bool apply(const Change& change) override {
+		if (change.kind == Change::Kind::Remove) {
+			remove(change.id);
+			return true;
+		}
+
+		const T* value = this->lookup(change.id);
+		if (!value)
+			return true;
+		auto found = placed.find(change.id);
+		if (found != placed.end() && found->second.first == key(*value)) {
+			PropertyList<T>& list = groups[found->second.first]->list;
+			list.set(list.indexOf(found->second.second), *value);
+			return true;
+		}
+		remove(change.id);
+		add(change.id, *value);
+		return true;
+	}
+
+	virtual void rebuild() override {
+		this->follow(sizes);
+		for (auto& [groupKey, group] : groups) {
+			group->list.clear();
+			group->origins.clear();
+		}
+		sizes.clear();
+		placed.clear();
+		for (auto& entry : this->source) {
+			add(entry.id, entry.value);
+		}
+	}
+
+public:
+	GroupedList(PropertyList<T>& source, KeyFunction key) : CollectionView<T>(source), key(std::move(key)) {
+		this->start();
+	}
+
+	PropertyMap<Key, size_t>& keys() {
+		return sizes;
+	}
+
+	// Created empty if no element has had this key yet.
+	PropertyList<T>& group(const Key& groupKey) {
+		return untracked([&]() -> PropertyList<T>& { return groupFor(groupKey).list; });
+	}
+};
+
+template<typename T, typename Predicate>
+FilteredList<T, Predicate> filter(PropertyList<T>& source, Predicate predicate) {
+	return FilteredList<T, Predicate>(source, std::move(predicate));
+}
+
+template<typename T, typename Function>
+MappedList<T, Function> map(PropertyList<T>& source, Function function) {
+	return MappedList<T, Function>(source, std::move(function));
+}
+
+template<typename T, typename KeyFunction>
+SortedList<T, KeyFunction> sortBy(PropertyList<T>& source, KeyFunction key) {
+	return SortedList<T, KeyFunction>(source, std::move(key));
+}
+
+template<typename T, typename KeyFunction>
+GroupedList<T, KeyFunction> groupBy(PropertyList<T>& source, KeyFunction key) {
+	return GroupedList<T, KeyFunction>(source, std::move(key));
+}
@@ -0,0 +1,262 @@
+#pragma once
+#include "Declarative.h"
+#include <unordered_map>
+#include <iomanip>
+
+
+// Snapshot of the part of a live graph reachable from the nodes passed to add(), in both
+// directions, for finding the bindings that dominate flush time. Execution counts and times
+// are only collected when DECLARATIVE_INSTRUMENTATION is defined to 1; without it they read
+// as zero. Nodes are described by their names where they have one.
+class GraphInspector {
+public:
+	enum class Kind : unsigned char {
+		Source,
+		Computed,
+		Reaction,
+		// A node of some other type, e.g. an element of a collection.
+		Other,
+	};
+
+	struct Node {
+		std::string name;
+		Kind kind;
+		// Nodes it reads, and nodes reading it, by index into nodes().
+		std::vector<size_t> triggers;
+		std::vector<size_t> dependents;
+		unsigned rank = 0;
+		unsigned long long version = 0;
+		unsigned long long executions = 0;
+		unsigned long long redundantExecutions = 0;
+		unsigned long long repeatedReads = 0;
+		// Inclusive of the upstream nodes it brought up to date.
+		std::chrono::nanoseconds executionTime{};
+
+		size_t fanIn() const {
+			return triggers.size();
+		}
+
+		size_t fanOut() const {
+			return dependents.size();
+		}
+	};
+
+private:
+	std::vector<Node> graph;
+	std::vector<PropertyBase*> properties;
+	std::vector<ReactionBase*> reactions;
+	std::unordered_map<const void*, size_t> indices;
+	std::vector<size_t> pending;
+
+	size_t visit(PropertyBase* property, ReactionBase* reaction) {
+		if (property && !reaction)
+			reaction = property->reactionSide();
+		if (reaction && !property)
+			property = reaction->propertySide();
+
+		const void* identity = property ? static_cast<const void*>(property) : static_cast<const void*>(reaction);
+		auto [found, inserted] = indices.try_emplace(identity, graph.size());
+		if (!inserted)
+			return found->second;
+
+		Node node;
+		if (property && reaction)
+			node.kind = Kind::Computed;
+		else if (reaction)
+			node.kind = dynamic_cast<Reaction*>(reaction) ? Kind::Reaction : Kind::Other;
+		else
+			node.kind = property->snapshotType() ? Kind::Source : Kind::Other;
+
+		if (property && property->getName())
+			node.name = property->getName();
+		else if (Reaction* plain = dynamic_cast<Reaction*>(reaction); plain && plain->getName())
+			node.name = plain->getName();
+		else
+			node.name = (reaction && !property ? "reaction#" : "property#") + std::to_string(graph.size());
+
+		graph.push_back(std::move(node));
+		properties.push_back(property);
+		reactions.push_back(reaction);
+		pending.push_back(graph.size() - 1);
+		return graph.size() - 1;
+	}
+
+	void walk() {
+		GraphLock lock(ReactiveContext::get());
+		while (!pending.empty()) {
+			size_t index = pending.back();
+			pending.pop_back();
+
+			if (ReactionBase* reaction = reactions[index]) {
+				for (Dependency* dependency = reaction->firstTrigger; dependency; dependency = dependency->nextTrigger) {
+					size_t trigger = visit(dependency->property, nullptr);
+					graph[index].triggers.push_back(trigger);
+				}
+				graph[index].rank = reaction->rank;
+#if DECLARATIVE_INSTRUMENTATION
+				const NodeStatistics& statistics = reaction->statistics;
+				graph[index].executions = statistics.executions;
+				graph[index].redundantExecutions = statistics.redundantExecutions;
+				graph[index].repeatedReads = statistics.repeatedReads;
+				graph[index].executionTime = statistics.executionTime;
+#endif
+			}
+			if (PropertyBase* property = properties[index]) {
+				for (Dependency* dependency = property->firstDependent; dependency; dependency = dependency->nextDependent) {
+					size_t dependent = visit(nullptr, dependency->reaction);
+					graph[index].dependents.push_back(dependent);
+				}
+				graph[index].version = property->version;
+			}
+		}
+	}
+
+	static std::string quoted(const std::string& text) {
+		std::string result = "\"";
+		for (char c : text) {
+			if (c == '"' || c == '\\')
+				result += '\\';
+			if (c == '\n')
+				result += "\\n";
+			else
+				result += c;
+		}
+		return result + "\"";
+	}
+
+	static const char* kindName(Kind kind) {
+		switch (kind) {
+		case Kind::Source: return "source";
+		case Kind::Computed: return "computed";
+		case Kind::Reaction: return "reaction";
+		default: return "other";
+		}
+	}
+
+	static double milliseconds(std::chrono::nanoseconds duration) {
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+	void addNode(PropertyBase* property, ReactionBase* reaction) {
+		visit(property, reaction);
+		walk();
+	}
+
+public:
+	GraphInspector() = default;
+
+	GraphInspector(const GraphInspector&) = delete;
+
+	template<typename T>
+	void add(Property<T>& property) {
+		addNode(&property, nullptr);
+	}
+
+	template<typename T, auto Source, auto... Sources>
+	void add(Computed<T, Source, Sources...>& computed) {
+		add(static_cast<Property<T>&>(computed));
+	}
+
+	void add(Reaction& reaction) {
+		addNode(nullptr, &reaction);
+	}
+
+	// Forgets everything collected, e.g. to inspect the graph again after it changed.
+	void clear() {
+		graph.clear();
+		properties.clear();
+		reactions.clear();
+		indices.clear();
+	}
+
+	const std::vector<Node>& nodes() const {
+		return graph;
+	}
+
+	// Indices of the nodes with the most execution time, most expensive first.
+	std::vector<size_t> hotSpots(size_t count = 10) const {
+		std::vector<size_t> order(graph.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		count = std::min(count, order.size());
+		std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](size_t a, size_t b) {
+			return graph[a].executionTime != graph[b].executionTime ? graph[a].executionTime > graph[b].executionTime : graph[a].executions > graph[b].executions;
+		});
+		order.resize(count);
+		return order;
+	}
+
+	// Graphviz; edges point the way changes travel, from a node to the nodes reading it.
+	void writeDot(std::ostream& stream) const {
+		stream << "digraph Declarative {\n\trankdir=LR;\n";
+		for (size_t i = 0; i < graph.size(); i++) {
+			const Node& node = graph[i];
+			std::ostringstream label;
+			label << node.name << "\n" << kindName(node.kind) << ", in " << node.fanIn() << ", out " << node.fanOut();
+			if (node.executions)
+				label << "\n" << node.executions << " runs, " << std::fixed << std::setprecision(3) << milliseconds(node.executionTime) << " ms";
+			stream << "\tn" << i << " [label=" << quoted(label.str()) << ", shape=" << (node.kind == Kind::Reaction ? "box" : "ellipse") << "];\n";
+		}
+		for (size_t i = 0; i < graph.size(); i++) {
+			for (size_t dependent : graph[i].dependents) {
+				stream << "\tn" << i << " -> n" << dependent << ";\n";
+			}
+		}
+		stream << "}\n";
+	}
+
+	void writeJson(std::ostream& stream) const {
+		stream << "{\"nodes\":[";
+		for (size_t i = 0; i < graph.size(); i++) {
+			const Node& node = graph[i];
+			stream << (i ? ",\n" : "\n") << "{\"id\":" << i << ",\"name\":" << quoted(node.name) << ",\"kind\":\"" << kindName(node.kind) << "\""
+				<< ",\"rank\":" << node.rank << ",\"version\":" << node.version
+				<< ",\"fanIn\":" << node.fanIn() << ",\"fanOut\":" << node.fanOut()
+				<< ",\"executions\":" << node.executions << ",\"redundantExecutions\":" << node.redundantExecutions
+				<< ",\"repeatedReads\":" << node.repeatedReads << ",\"executionTimeNs\":" << node.executionTime.count() << "}";
+		}
+		stream << "\n],\"edges\":[";
+		bool first = true;
+		for (size_t i = 0; i < graph.size(); i++) {
+			for (size_t dependent : graph[i].dependents) {
+				stream << (first ? "\n" : ",\n") << "{\"from\":" << i << ",\"to\":" << dependent << "}";
+				first = false;
+			}
+		}
+		stream << "\n]}\n";
+	}
+
+	// Plain text summary: where the time goes, the widest bindings, and the ones that keep
+	// recomputing to the same value or reading the same node over and over.
+	void writeReport(std::ostream& stream, size_t count = 10) const {
+		auto top = [&](const char* title, auto key) {
+			std::vector<size_t> order;
+			for (size_t i = 0; i < graph.size(); i++) {
+				if (key(graph[i]) > 0)
+					order.push_back(i);
+			}
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return key(graph[a]) > key(graph[b]); });
+			if (order.size() > count)
+				order.resize(count);
+
+			stream << title << "\n";
+			for (size_t i : order) {
+				const Node& node = graph[i];
+				stream << "  " << std::left << std::setw(32) << node.name << std::right
+					<< std::setw(8) << node.fanIn() << " in" << std::setw(8) << node.fanOut() << " out"
+					<< std::setw(10) << node.executions << " runs" << std::setw(10) << node.redundantExecutions << " redundant"
+					<< std::setw(10) << node.repeatedReads << " rereads" << std::setw(12) << std::fixed << std::setprecision(3)
+					<< milliseconds(node.executionTime) << " ms\n";
+			}
+			if (order.empty())
+				stream << "  (none)\n";
+		};
+
+		stream << graph.size() << " nodes\n";
+		top("Execution time:", [](const Node& node) { return double(node.executionTime.count()); });
+		top("Widest bindings:", [](const Node& node) { return double(node.fanIn()); });
+		top("Redundant recomputes:", [](const Node& node) { return double(node.redundantExecutions); });
+		top("Repeated reads:", [](const Node& node) { return double(node.repeatedReads); });
+	}
+};